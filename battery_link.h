@@ -0,0 +1,370 @@
+// battery_link.h
+// 一个串口连接：串口 + 分帧解码 + 命令引擎 + 遥测快照
+//
+// 单窗口使用时由自己的接收线程读串口；多端口工位模式下不创建线程，
+// 由共享的工作线程循环调用 Poll() 和 Service()。
+// 也可以打开一个抓包文件回放，回放的数据走与串口接收完全相同的分发路径。
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "serial_port.h"
+#include "frame_codec.h"
+#include "battery_telemetry.h"
+#include "telemetry_series.h"
+#include "command_engine.h"
+#include "capture_file.h"
+#include "pipeline_metrics.h"
+
+class BatteryLink {
+public:
+    typedef std::function<void(const uint8_t*, size_t)> RawHandler;
+    typedef std::function<void(const BatteryFrame&)> FrameHandler;
+    typedef std::function<void(const std::string&)> ErrorHandler;
+    typedef std::function<void(int, const uint8_t*, size_t)> TapHandler;
+
+    BatteryLink()
+        : mode(FRAME_TEXT), baudRate(0), decoder(nullptr), engine(nullptr),
+          readerThread(nullptr), running(false), failed(false), replaying(false), replaySpeed(1),
+          replayBase(0), replayTime(0), timeOffset(0), created(std::chrono::steady_clock::now()),
+          queueWrites(false), metrics(nullptr), readTime(0) {}
+
+    ~BatteryLink() { Close(); }
+
+    // 文本模式下收到的原始数据（接收线程中回调）
+    void SetRawHandler(const RawHandler& h) { onRaw = h; }
+    // 二进制模式下既不是遥测也不是命令应答的帧
+    void SetFrameHandler(const FrameHandler& h) { onFrame = h; }
+    // 收发字节数计入 metrics，在打开连接前设置
+    void SetMetrics(PipelineMetrics* m) { metrics = m; }
+    // 串口读写出错（如设备拔出），每次连接只回调一次
+    void SetErrorHandler(const ErrorHandler& h) { onError = h; }
+    // 不论分帧方式，收发的每一段原始字节（方向为 CAPTURE_RX / CAPTURE_TX），在打开连接前设置
+    void SetTapHandler(const TapHandler& h) { onTap = h; }
+
+    // ownThreads 为 false 时不创建接收线程和命令超时线程，由调用者驱动；
+    // 这时写串口也不阻塞：写不完的数据排队，由 Poll() 接着写，WRITE_TIMEOUT_MS 内写不出去算失败，
+    // 这样一个卡住或拔掉的端口不会拖住同一线程上的其他端口
+    static const int WRITE_TIMEOUT_MS = 1000;
+
+    bool Open(const std::string& name, int baud, FrameMode frameMode, std::string& error, bool ownThreads = true) {
+        Close();
+        if (!port.Open(name, baud, error)) return false;
+
+        portName = name;
+        baudRate = baud;
+        mode = frameMode;
+        failed = false;
+
+        // 之前回放过时曲线时间可能已经超过本地时钟，接着往后排
+        double first, last;
+        if (series.GetRange(first, last) && last > SampleTime()) timeOffset += last - SampleTime();
+
+        queueWrites = !ownThreads;
+        txQueue.clear();
+        CreateDecoder(ownThreads);
+
+        running = true;
+        if (ownThreads) {
+            readerThread = new std::thread(&BatteryLink::ReaderThread, this);
+        }
+        return true;
+    }
+
+    // 回放抓包文件中接收方向的数据；speed 为回放倍速，0 表示不等待、尽快回放
+    // 回放期间发出的数据直接丢弃，回放结束时通过错误回调通知
+    bool OpenReplay(const std::string& path, FrameMode frameMode, double speed, std::string& error) {
+        Close();
+        if (!replayFile.Open(path, error)) return false;
+
+        portName = path;
+        baudRate = 0;
+        mode = frameMode;
+        failed = false;
+
+        // 回放的点接在已有曲线后面，按记录里的时间排列
+        double first, last;
+        replayBase = SampleTime();
+        if (series.GetRange(first, last) && last > replayBase) replayBase = last;
+        replayTime = replayBase;
+        replaying = true;
+        replaySpeed = speed;
+
+        CreateDecoder(true);
+
+        running = true;
+        readerThread = new std::thread(&BatteryLink::ReplayThread, this);
+        return true;
+    }
+
+    // 停止接收，取消未完成的命令，关闭串口
+    void Close() {
+        running = false;
+        if (readerThread) {
+            readerThread->join();
+            delete readerThread;
+            readerThread = nullptr;
+        }
+        if (engine) {
+            delete engine;      // 未完成的命令会以 cancelled 结束
+            engine = nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            port.Close();
+        }
+        if (decoder) {
+            delete decoder;
+            decoder = nullptr;
+        }
+        if (replaying) {
+            replayFile.Close();
+            replaying = false;
+        }
+    }
+
+    bool IsOpen() const { return port.IsOpen() || replaying; }
+    bool IsReplaying() const { return replaying; }
+
+    // 把收发的原始数据记录到抓包文件，与连接的打开关闭无关
+    bool StartCapture(const std::string& path, std::string& error) { return capture.Open(path, error); }
+    void StopCapture() { capture.Close(); }
+    bool IsCapturing() { return capture.IsOpen(); }
+    uint64_t GetCaptureBytes() { return capture.GetBytes(); }
+
+    // 读一次串口并分发，返回读到的字节数
+    size_t Poll() {
+        if (!running || failed) return 0;
+        if (queueWrites && !FlushQueue()) {
+            ReportError("Serial port write timed out");
+            return 0;
+        }
+        int n = port.Read(readBuffer, sizeof(readBuffer));
+        if (n < 0) {
+            ReportError("Serial port read failed");
+            return 0;
+        }
+        if (n > 0) Dispatch(readBuffer, n);
+        return n;
+    }
+
+    // 共享线程模式下定期调用，处理命令超时重发
+    void Service() {
+        if (engine) engine->CheckTimeouts();
+    }
+
+    // 写串口，多个线程可以同时调用
+    bool Write(const uint8_t* data, size_t length) {
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            if (replaying) return true;
+            if (port.IsOpen() && !failed && queueWrites) {
+                if (txQueue.empty()) txSince = std::chrono::steady_clock::now();
+                txQueue.insert(txQueue.end(), data, data + length);
+                if (FlushLocked()) return true;
+                length = 0;     // FlushLocked 已经计入丢弃的字节
+            } else if (port.IsOpen() && !failed && port.Write(data, length)) {
+                Sent(data, length);
+                return true;
+            }
+        }
+        if (metrics) metrics->droppedBytes.Add(length);
+        if (port.IsOpen()) ReportError("Serial port write failed");
+        return false;
+    }
+
+    // 连接中切换波特率（速率协商用），等已写出的数据发完再生效
+    // （POSIX 用 TCSADRAIN，Windows 上 SerialPort 先轮询驱动发送队列清空）
+    bool SetBaudRate(int baud) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (replaying || !port.IsOpen()) return false;
+        // 排队的数据也要按原速率发完
+        if (!txQueue.empty()) {
+            if (!port.Write(txQueue.data(), txQueue.size())) return false;
+            Sent(txQueue.data(), txQueue.size());
+            txQueue.clear();
+        }
+        if (!port.SetBaudRate(baud)) return false;
+        baudRate = baud;
+        return true;
+    }
+
+    CommandEngine* GetEngine() { return engine; }
+    TelemetrySnapshot& GetTelemetry() { return telemetry; }
+    // 每一帧遥测都记入曲线，不受界面刷新节拍影响；跨连接保留
+    TelemetrySeries& GetSeries() { return series; }
+    FrameMode GetMode() const { return mode; }
+    int GetBaudRate() const { return baudRate; }
+    const std::string& GetPortName() const { return portName; }
+
+private:
+    void CreateDecoder(bool ownTimer) {
+        decoder = CreateFrameDecoder(mode);
+        if (decoder) {
+            decoder->SetHandler([this](const BatteryFrame& frame) { OnDecoded(frame); });
+            engine = new CommandEngine(mode, [this](const std::vector<uint8_t>& bytes) {
+                return Write(bytes.data(), bytes.size());
+            }, 8, ownTimer);
+        }
+    }
+
+    void ReaderThread() {
+        while (running) {
+            // 没有数据时才休眠，数据连续到达时不额外增加延迟
+            if (Poll() == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    // 按记录的时间间隔（除以倍速）分发接收数据
+    void ReplayThread() {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        CaptureRecord rec;
+        uint64_t bytes = 0;
+        while (running && replayFile.Next(rec)) {
+            if (rec.direction != CAPTURE_RX) continue;
+            if (replaySpeed > 0) {
+                Clock::time_point due = start + std::chrono::nanoseconds(static_cast<int64_t>(rec.time / replaySpeed));
+                // 分段休眠，关闭时不用等到下一条记录
+                while (running && Clock::now() < due) {
+                    Clock::time_point next = Clock::now() + std::chrono::milliseconds(50);
+                    std::this_thread::sleep_until(due < next ? due : next);
+                }
+            }
+            replayTime = replayBase + rec.time / 1e9;
+            Dispatch(rec.data, rec.length);
+            bytes += rec.length;
+        }
+        if (running) ReportError("Replay finished, " + std::to_string(bytes) + " bytes");
+    }
+
+    void Dispatch(const uint8_t* data, size_t length) {
+        readTime = MetricsNow();
+        if (metrics) metrics->rxBytes.Add(length);
+        if (!replaying) capture.Append(CAPTURE_RX, data, length);
+        if (onTap) onTap(CAPTURE_RX, data, length);
+        if (decoder) {
+            // 二进制协议：交给分帧层，完整的帧由 OnDecoded 分发
+            decoder->Feed(data, length);
+        } else if (onRaw) {
+            RecordReadToEvent();
+            onRaw(data, length);
+        }
+    }
+
+    void OnDecoded(const BatteryFrame& frame) {
+        // 遥测帧只更新快照，由界面按固定节拍读取
+        if (frame.type == FRAME_TYPE_TELEMETRY) {
+            TelemetryRecord rec;
+            if (ParseTelemetry(frame.data, frame.length, rec)) {
+                telemetry.Update(rec);
+                series.Append(SampleTime(), rec);
+                RecordReadToEvent();
+            }
+            return;
+        }
+        // 命令应答交给命令引擎匹配，完成回调就是这一帧的“事件”
+        if (engine && (frame.type & FRAME_TYPE_RESPONSE)) {
+            RecordReadToEvent();
+            engine->OnFrame(frame);
+            return;
+        }
+        if (onFrame) {
+            RecordReadToEvent();
+            onFrame(frame);
+        }
+    }
+
+    // 读到数据到交给处理方的时间，遥测、命令应答、其他帧和原始数据都在这里记录
+    void RecordReadToEvent() {
+        if (metrics) metrics->readToEvent.Record(MetricsNow() - readTime);
+    }
+
+    // 曲线时间（秒）：实时连接用本地时钟，回放用记录的时间
+    double SampleTime() const {
+        if (replaying) return replayTime;
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - created).count() + timeOffset;
+    }
+
+    // 持 writeMutex 调用：数据已写出
+    void Sent(const uint8_t* data, size_t length) {
+        capture.Append(CAPTURE_TX, data, length);
+        if (onTap) onTap(CAPTURE_TX, data, length);
+        if (metrics) metrics->txBytes.Add(length);
+    }
+
+    bool FlushQueue() {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        return FlushLocked();
+    }
+
+    // 持 writeMutex 调用：不阻塞地写出排队的数据；
+    // 出错或超过 WRITE_TIMEOUT_MS 没有进展时丢弃排队的数据，返回 false
+    bool FlushLocked() {
+        while (!txQueue.empty()) {
+            int n = port.WriteSome(txQueue.data(), txQueue.size());
+            if (n < 0) break;
+            if (n == 0) {
+                if (std::chrono::steady_clock::now() - txSince < std::chrono::milliseconds(WRITE_TIMEOUT_MS)) return true;
+                break;
+            }
+            Sent(txQueue.data(), n);
+            txQueue.erase(txQueue.begin(), txQueue.begin() + n);
+            txSince = std::chrono::steady_clock::now();
+        }
+        if (txQueue.empty()) return true;
+        if (metrics) metrics->droppedBytes.Add(txQueue.size());
+        txQueue.clear();
+        return false;
+    }
+
+    void ReportError(const std::string& message) {
+        if (failed.exchange(true)) return;
+        if (onError) onError(message);
+    }
+
+    SerialPort port;
+    std::string portName;
+    FrameMode mode;
+    std::atomic<int> baudRate;
+
+    FrameDecoder* decoder;
+    CommandEngine* engine;
+    TelemetrySnapshot telemetry;
+    TelemetrySeries series;
+
+    std::thread* readerThread;
+    std::atomic<bool> running;
+    std::atomic<bool> failed;
+    std::mutex writeMutex;
+    uint8_t readBuffer[4096];
+
+    CaptureWriter capture;
+    CaptureReader replayFile;
+    std::atomic<bool> replaying;
+    double replaySpeed;
+    double replayBase;
+    double replayTime;
+    double timeOffset;
+    std::chrono::steady_clock::time_point created;
+    // 共享线程模式下还没写出去的数据和最近一次写出进展的时间
+    bool queueWrites;
+    std::vector<uint8_t> txQueue;
+    std::chrono::steady_clock::time_point txSince;
+
+    PipelineMetrics* metrics;
+    int64_t readTime;
+
+    RawHandler onRaw;
+    FrameHandler onFrame;
+    ErrorHandler onError;
+    TapHandler onTap;
+};
@@ -0,0 +1,165 @@
+// battery_protocol.h
+// 电池协议的帧类型和负载格式定义，所有多字节字段均为小端
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <string>
+
+// 帧类型
+enum BatteryFrameType {
+    FRAME_TYPE_TELEMETRY = 0x01,    // 设备周期上报的遥测数据
+
+    // 命令：主机发出，设备用 (命令 | FRAME_TYPE_RESPONSE) 应答，seq 原样带回
+    CMD_RESET = 0x10,
+    CMD_CALIBRATE = 0x11,           // 负载 [byFactory:1]
+    CMD_TOLERATE = 0x12,
+    CMD_CLEAN = 0x13,
+    CMD_SET_SN = 0x14,              // 负载 [sn:16 ASCII]
+
+    // 线路速率协商
+    // 设备用原速率应答后切换；idleMs 不为 0 时，切换后连续 idleMs 没有收到有效帧就回到上电时的速率
+    CMD_SET_BAUD = 0x15,            // 负载 [baud:4][idleMs:2]，不支持的速率应答失败且不切换
+    CMD_LINK_PROBE = 0x16,          // 负载 [data]，应答原样带回 data
+
+    // 固件下载
+    CMD_OTA_BEGIN = 0x20,           // 负载 [size:4][chunkSize:2]，设备擦除下载区
+    CMD_OTA_DATA = 0x21,            // 负载 [offset:4][data]
+    CMD_OTA_END = 0x22,             // 设备校验镜像尾部的长度和 CRC32
+
+    // 按块比较更新
+    CMD_FLASH_CRC = 0x23,           // 负载 [address:4][blockSize:2][count:2]，应答 [crc32:4] * count
+    CMD_FLASH_BLOCK = 0x24,         // 负载 [address:4][data:blockSize]，设备擦除并写入整块
+
+    FRAME_TYPE_RESPONSE = 0x80      // 应答标志位，应答负载 [status:1][data...]
+};
+
+// 应答状态
+enum CommandStatus {
+    CMD_STATUS_OK = 0,
+    CMD_STATUS_FAILED = 1,          // 设备执行失败
+    CMD_STATUS_BUSY = 2,
+    CMD_STATUS_TIMEOUT = 0x100,     // 以下为主机侧状态：重试用尽
+    CMD_STATUS_CANCELLED = 0x101    // 断开连接时未完成
+};
+
+inline const char* CommandName(uint8_t command) {
+    switch (command) {
+        case CMD_RESET:     return "Reset";
+        case CMD_CALIBRATE: return "Calibrate";
+        case CMD_TOLERATE:  return "Tolerate";
+        case CMD_CLEAN:     return "Clean";
+        case CMD_SET_SN:    return "Set SN";
+        case CMD_SET_BAUD:  return "Set baud";
+        case CMD_LINK_PROBE: return "Link probe";
+        case CMD_OTA_BEGIN: return "OTA begin";
+        case CMD_OTA_DATA:  return "OTA data";
+        case CMD_OTA_END:   return "OTA end";
+        case CMD_FLASH_CRC:   return "Flash CRC";
+        case CMD_FLASH_BLOCK: return "Flash block";
+        default:            return "Command";
+    }
+}
+
+inline const char* CommandStatusName(int status) {
+    switch (status) {
+        case CMD_STATUS_OK:        return "OK";
+        case CMD_STATUS_FAILED:    return "failed";
+        case CMD_STATUS_BUSY:      return "busy";
+        case CMD_STATUS_TIMEOUT:   return "timeout";
+        case CMD_STATUS_CANCELLED: return "cancelled";
+        default:                   return "error";
+    }
+}
+
+// 小端读写辅助函数
+inline uint16_t GetLe16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t GetLe32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void PutLe16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v & 0xFF));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+inline void PutLe32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v & 0xFF));
+    out.push_back(static_cast<uint8_t>((v >> 8) & 0xFF));
+    out.push_back(static_cast<uint8_t>((v >> 16) & 0xFF));
+    out.push_back(static_cast<uint8_t>(v >> 24));
+}
+
+// 遥测负载：
+//   [time:4 秒][voltage:2 mV][cellVoltage:2 mV][current:4 mA 有符号]
+//   [temperature:2 0.1℃ 有符号][capacity:4 mAh][cycles:2][sn:16 ASCII]
+static const size_t TELEMETRY_SN_SIZE = 16;
+static const size_t TELEMETRY_PAYLOAD_SIZE = 36;
+
+struct TelemetryRecord {
+    uint32_t batteryTime;
+    uint16_t voltage;
+    uint16_t cellVoltage;
+    int32_t current;
+    int16_t temperature;
+    uint32_t capacity;
+    uint16_t cycles;
+    char sn[TELEMETRY_SN_SIZE + 1];
+};
+
+inline bool ParseTelemetry(const uint8_t* data, size_t length, TelemetryRecord& rec) {
+    if (length < TELEMETRY_PAYLOAD_SIZE) return false;
+    rec.batteryTime = GetLe32(data);
+    rec.voltage = GetLe16(data + 4);
+    rec.cellVoltage = GetLe16(data + 6);
+    rec.current = static_cast<int32_t>(GetLe32(data + 8));
+    rec.temperature = static_cast<int16_t>(GetLe16(data + 12));
+    rec.capacity = GetLe32(data + 14);
+    rec.cycles = GetLe16(data + 18);
+    memcpy(rec.sn, data + 20, TELEMETRY_SN_SIZE);
+    rec.sn[TELEMETRY_SN_SIZE] = '\0';
+    return true;
+}
+
+inline void BuildTelemetry(const TelemetryRecord& rec, std::vector<uint8_t>& out) {
+    PutLe32(out, rec.batteryTime);
+    PutLe16(out, rec.voltage);
+    PutLe16(out, rec.cellVoltage);
+    PutLe32(out, static_cast<uint32_t>(rec.current));
+    PutLe16(out, static_cast<uint16_t>(rec.temperature));
+    PutLe32(out, rec.capacity);
+    PutLe16(out, rec.cycles);
+    size_t snLen = strnlen(rec.sn, TELEMETRY_SN_SIZE);
+    out.insert(out.end(), rec.sn, rec.sn + snLen);
+    out.insert(out.end(), TELEMETRY_SN_SIZE - snLen, 0);
+}
+
+// 序列号自增：末尾的数字部分加一并保持位数，例如 BAT0099 -> BAT0100
+inline std::string IncrementSerialNumber(const std::string& sn) {
+    std::string result = sn;
+    size_t i = result.size();
+    while (i > 0 && result[i - 1] >= '0' && result[i - 1] <= '9') {
+        i--;
+        if (result[i] != '9') {
+            result[i]++;
+            return result;
+        }
+        result[i] = '0';
+    }
+    // 全部进位（或没有数字）时在数字前补 1
+    result.insert(i, 1, '1');
+    return result;
+}
+
+// 序列号负载：不足 16 字节补 0，超出截断
+inline void BuildSerialNumber(const std::string& sn, std::vector<uint8_t>& out) {
+    size_t n = sn.size() < TELEMETRY_SN_SIZE ? sn.size() : TELEMETRY_SN_SIZE;
+    out.insert(out.end(), sn.begin(), sn.begin() + n);
+    out.insert(out.end(), TELEMETRY_SN_SIZE - n, 0);
+}
@@ -0,0 +1,623 @@
+// battery_simulator.h
+// 虚拟电池设备：打开一对伪终端，在主端按电池协议收发，从端给串口工具打开
+//
+// 按设定频率上报遥测（可以一直发到线路占满），应答全部命令，
+// 包括 OTA 下载、按块比较更新和线路速率协商；可以注入坏帧、垃圾字节、应答延迟和断开。
+// 协商切换速率后，从端被设成的波特率与设备速率不一致时，收发的字节都会被打乱，
+// 与真实串口两端速率不匹配时一样。
+// 只支持 POSIX 系统，供 battsim 和 loadtest 使用，不依赖 wxWidgets。
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include "frame_codec.h"
+#include "battery_protocol.h"
+#include "crc32.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <poll.h>
+
+// OTA 镜像尾部：magic1 magic2 长度 CRC32 magic2 magic1，与合并工具生成的 ota.bin 一致
+static const uint32_t OTA_MAGIC1 = 0x5A5A5A5A;
+static const uint32_t OTA_MAGIC2 = 0x51709394;
+static const size_t OTA_TRAILER_SIZE = 24;
+
+// 命令行里的分帧方式名称：cobs / slip / length
+inline bool ParseFrameMode(const std::string& name, FrameMode& mode) {
+    if (name == "cobs") mode = FRAME_COBS;
+    else if (name == "slip") mode = FRAME_SLIP;
+    else if (name == "length") mode = FRAME_LENGTH;
+    else return false;
+    return true;
+}
+
+// 故障注入设置
+struct SimulatorFaults {
+    double corruptRate;     // 每帧被改坏一个字节的概率
+    double garbageRate;     // 每帧前插入随机垃圾字节的概率
+    int responseDelayMs;    // 命令应答延迟
+    int maxReliableBaud;    // 线路速率高于此值时收发的字节都被打乱，0 不限
+};
+
+// 累计统计
+struct SimulatorStats {
+    uint64_t telemetrySent;
+    uint64_t commandsHandled;
+    uint64_t corruptedFrames;
+    uint64_t garbageBytes;
+    uint64_t bytesOut;
+    uint64_t bytesIn;
+    uint32_t disconnects;
+    uint32_t baudChanges;   // CMD_SET_BAUD 切换次数
+    uint32_t baudReverts;   // 空闲超时回到上电速率的次数
+    int lineBaud;           // 当前设备速率，0 表示还没有协商过（跟随主机）
+};
+
+// 设备支持的波特率，以及伪终端从端 termios 里对应的速率常量
+struct SimulatorBaud {
+    int baud;
+    speed_t speed;
+};
+
+static const SimulatorBaud SIMULATOR_BAUDS[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 921600, B921600 },
+#ifdef B1000000
+    { 1000000, B1000000 }, { 1500000, B1500000 }, { 2000000, B2000000 }, { 3000000, B3000000 },
+#endif
+};
+
+class BatterySimulator {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // mode 必须是二进制分帧方式（COBS/SLIP/长度前缀）
+    BatterySimulator(FrameMode mode = FRAME_COBS, size_t flashSize = 256 * 1024)
+        : mode(mode), master(-1), thread(nullptr), running(false),
+          telemetryRate(10), rateSent(0), baudRate(0), disconnectMs(-1), flash(flashSize, 0xFF),
+          serialNumber("SIM0000001"), rng(12345), maxBaud(3000000), outputSent(0),
+          lineBaud(0), powerOnBaud(0), pendingBaud(0), pendingIdleMs(0), revertIdleMs(0) {
+        memset(&faults, 0, sizeof(faults));
+        memset(&stats, 0, sizeof(stats));
+        decoder = CreateFrameDecoder(mode);
+        decoder->SetHandler([this](const BatteryFrame& frame) { OnCommand(frame); });
+    }
+
+    ~BatterySimulator() {
+        Stop();
+        ClosePty();
+        delete decoder;
+    }
+
+    // 创建伪终端，linkPath 非空时在该路径建一个指向从端的符号链接，
+    // 断开重连后从端名字会变，链接始终指向当前的从端
+    bool Open(const std::string& linkPath, std::string& error) {
+        link = linkPath;
+        return OpenPty(error);
+    }
+
+    // 串口工具应打开的设备名
+    std::string GetPortName() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return link.empty() ? slaveName : link;
+    }
+
+    void Start() {
+        if (thread) return;
+        running = true;
+        startTime = Clock::now();
+        SetTelemetryRate(telemetryRate);
+        thread = new std::thread(&BatterySimulator::DeviceThread, this);
+    }
+
+    void Stop() {
+        running = false;
+        if (thread) {
+            thread->join();
+            delete thread;
+            thread = nullptr;
+        }
+    }
+
+    // 遥测频率（帧/秒），0 停止上报，小于 0 表示一直发到线路占满
+    void SetTelemetryRate(double hz) {
+        std::lock_guard<std::mutex> lock(mutex);
+        telemetryRate = hz;
+        rateStart = Clock::now();
+        rateSent = 0;
+    }
+
+    // 按波特率限速（8N1 每字节 10 位），0 不限速，只受伪终端缓冲区限制
+    void SetBaudRate(int baud) {
+        std::lock_guard<std::mutex> lock(mutex);
+        baudRate = baud;
+    }
+
+    void SetFaults(const SimulatorFaults& f) {
+        std::lock_guard<std::mutex> lock(mutex);
+        faults = f;
+    }
+
+    // CMD_SET_BAUD 能切换到的最高速率，更高的应答失败
+    void SetMaxBaudRate(int baud) {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxBaud = baud;
+    }
+
+    // 关闭主端模拟拔线（对端读写出错），downMs 毫秒后换一个新的伪终端重新上线
+    void Disconnect(int downMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        disconnectMs = downMs;
+    }
+
+    SimulatorStats GetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    // 设备当前的序列号（CMD_SET_SN 写入）
+    std::string GetSerialNumber() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return serialNumber;
+    }
+
+    // 按块比较更新写入的 flash 内容
+    std::vector<uint8_t> GetFlash() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return flash;
+    }
+
+private:
+    struct Response {
+        Clock::time_point due;
+        std::vector<uint8_t> bytes;
+        int switchBaud;         // 不为 0 时这条应答发完后切换到该速率
+        int idleMs;
+    };
+
+    // 按波特率折算的线路额度（8N1 每字节 10 位），收发两个方向各一个
+    struct LineBudget {
+        LineBudget() : bytes(0) {}
+
+        // 现在最多能收发的字节数，baud 为 0 时不限
+        size_t Available(Clock::time_point now, int baud, size_t want) {
+            if (baud <= 0) return want;
+            double budget = std::chrono::duration<double>(now - start).count() * baud / 10 - bytes;
+            // 空闲后重新计时，不攒下一大段额度
+            if (budget > 1024) {
+                start = now;
+                bytes = 0;
+                budget = 1024;
+            }
+            if (budget < 1) return 0;
+            return want > budget ? static_cast<size_t>(budget) : want;
+        }
+
+        void Use(size_t n) { bytes += n; }
+
+        Clock::time_point start;
+        uint64_t bytes;
+    };
+
+    bool OpenPty(std::string& error) {
+        int fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+            error = std::string("Failed to create pty: ") + strerror(errno);
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        const char* name = ptsname(fd);
+        if (!name) {
+            error = std::string("Failed to get pty name: ") + strerror(errno);
+            close(fd);
+            return false;
+        }
+        // 主端也设成原始模式，否则换行、流控字符会被终端层改写
+        struct termios tio;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        if (!link.empty()) {
+            unlink(link.c_str());
+            if (symlink(name, link.c_str()) != 0) {
+                error = "Failed to create link " + link + ": " + strerror(errno);
+                close(fd);
+                return false;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        master = fd;
+        slaveName = name;
+        return true;
+    }
+
+    void ClosePty() {
+        if (master >= 0) {
+            close(master);
+            master = -1;
+        }
+        if (!link.empty()) unlink(link.c_str());
+    }
+
+    void DeviceThread() {
+        uint8_t buffer[4096];
+        while (running) {
+            int down, baud, reliable;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                down = disconnectMs;
+                disconnectMs = -1;
+                baud = baudRate;
+                reliable = faults.maxReliableBaud;
+            }
+            if (down >= 0) Reconnect(down);
+            if (master < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            bool busy = false;
+            Clock::time_point now = Clock::now();
+            if (lineBaud != 0 && lineBaud != powerOnBaud && revertIdleMs > 0 &&
+                now - lastActivity > std::chrono::milliseconds(revertIdleMs)) {
+                SetLineBaud(powerOnBaud, false);
+            }
+            // 限速时按协商后的速率计算
+            if (baud > 0 && lineBaud > 0) baud = lineBaud;
+            bool garbled = lineBaud != 0 &&
+                (HostBaud() != lineBaud || (reliable > 0 && lineBaud > reliable));
+
+            // 接收方向也按波特率限速，主机写得太快时由伪终端缓冲区反压
+            size_t want = rxLine.Available(now, baud, sizeof(buffer));
+            ssize_t n = want > 0 ? read(master, buffer, want) : 0;
+            if (n > 0) {
+                rxLine.Use(n);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stats.bytesIn += n;
+                }
+                if (garbled) Garble(buffer, n);
+                decoder->Feed(buffer, n);
+                busy = true;
+            }
+
+            // 切换速率的应答之后的数据要等切换完成再发
+            while (!responses.empty() && responses.front().due <= now && pendingBaud == 0) {
+                output.insert(output.end(), responses.front().bytes.begin(), responses.front().bytes.end());
+                pendingBaud = responses.front().switchBaud;
+                pendingIdleMs = responses.front().idleMs;
+                // 上电速率要在应答发出前记下，主机收到应答后可能马上就切换了
+                if (pendingBaud != 0 && lineBaud == 0) {
+                    powerOnBaud = HostBaud();
+                    lineBaud = powerOnBaud;
+                }
+                responses.pop_front();
+                lastActivity = now;
+            }
+            if (pendingBaud == 0) EmitTelemetry(now);
+            if (Flush(now, baud, garbled)) busy = true;
+            // 应答全部写出后才切换，它是按原速率发出的
+            if (pendingBaud != 0 && outputSent == output.size()) {
+                revertIdleMs = pendingIdleMs;
+                SetLineBaud(pendingBaud, true);
+                pendingBaud = 0;
+            }
+
+            // 没有收发时才等待，线路占满时不额外增加间隔
+            if (!busy) {
+                struct pollfd pfd = { master, POLLIN, 0 };
+                poll(&pfd, 1, 1);
+                // 从端还没有被打开或已经关闭
+                if (pfd.revents & POLLHUP) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+
+    void Reconnect(int downMs) {
+        ClosePty();
+        output.clear();
+        outputSent = 0;
+        responses.clear();
+        decoder->Reset();
+        // 重新上线相当于设备重新上电
+        lineBaud = 0;
+        pendingBaud = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.disconnects++;
+        }
+        Clock::time_point due = Clock::now() + std::chrono::milliseconds(downMs);
+        while (running && Clock::now() < due) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::string error;
+        if (running && !OpenPty(error)) fprintf(stderr, "%s\n", error.c_str());
+    }
+
+    // 按频率补齐该发的遥测帧；输出缓冲里还有积压时先不生成，
+    // 避免命令应答排在一大段遥测后面
+    void EmitTelemetry(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (telemetryRate == 0 || output.size() - outputSent > 256) return;
+
+        uint64_t due;
+        if (telemetryRate < 0) {
+            due = rateSent + 16;
+        } else {
+            double seconds = std::chrono::duration<double>(now - rateStart).count();
+            due = static_cast<uint64_t>(seconds * telemetryRate) + 1;
+        }
+        for (int i = 0; rateSent < due && i < 64; i++, rateSent++) {
+            TelemetryRecord rec;
+            MakeTelemetry(now, rec);
+            std::vector<uint8_t> payload;
+            BuildTelemetry(rec, payload);
+            AppendFrame(FRAME_TYPE_TELEMETRY, static_cast<uint8_t>(stats.telemetrySent), payload, output);
+            stats.telemetrySent++;
+        }
+        // 跟不上设定频率时不补发积压的帧
+        if (rateSent < due && telemetryRate > 0) rateSent = due;
+    }
+
+    // 持锁调用：生成一组缓慢变化的遥测值
+    void MakeTelemetry(Clock::time_point now, TelemetryRecord& rec) {
+        double t = std::chrono::duration<double>(now - startTime).count();
+        memset(&rec, 0, sizeof(rec));
+        rec.batteryTime = static_cast<uint32_t>(t);
+        rec.voltage = static_cast<uint16_t>(12000 + 400 * sin(t * 0.5));
+        rec.cellVoltage = static_cast<uint16_t>(rec.voltage / 3);
+        rec.current = static_cast<int32_t>(1500 * sin(t * 0.2));
+        rec.temperature = static_cast<int16_t>(250 + 30 * sin(t * 0.05));
+        rec.capacity = 5000 - static_cast<uint32_t>(t) % 5000;
+        rec.cycles = 42;
+        strncpy(rec.sn, serialNumber.c_str(), TELEMETRY_SN_SIZE);
+    }
+
+    // 持锁调用：编码一帧，按设置注入垃圾字节和坏字节
+    void AppendFrame(uint8_t type, uint8_t seq, const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+        std::uniform_real_distribution<double> chance(0, 1);
+        if (faults.garbageRate > 0 && chance(rng) < faults.garbageRate) {
+            size_t count = 1 + rng() % 16;
+            for (size_t i = 0; i < count; i++) out.push_back(static_cast<uint8_t>(rng()));
+            stats.garbageBytes += count;
+        }
+        size_t start = out.size();
+        EncodeFrame(mode, type, seq, payload.data(), payload.size(), out);
+        if (faults.corruptRate > 0 && chance(rng) < faults.corruptRate) {
+            // 避开首尾的分隔符，改坏帧中间的一个字节
+            size_t length = out.size() - start;
+            size_t index = start + 1 + rng() % (length - 2);
+            out[index] ^= static_cast<uint8_t>(1 + rng() % 255);
+            stats.corruptedFrames++;
+        }
+    }
+
+    // 切换速率：空闲超时后回到上电速率（第一次排队切换应答时记下的主机速率）
+    void SetLineBaud(int baud, bool requested) {
+        lineBaud = baud;
+        lastActivity = Clock::now();
+        // 按新速率重新计算线路额度，不沿用旧速率下累计的字节数
+        rxLine = LineBudget();
+        txLine = LineBudget();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (requested) stats.baudChanges++;
+        else stats.baudReverts++;
+        stats.lineBaud = baud;
+    }
+
+    // 主机在从端设置的波特率；Linux 上对主端取 termios 得到的就是从端的设置
+    int HostBaud() {
+        struct termios tio;
+        if (tcgetattr(master, &tio) != 0) return 0;
+        speed_t speed = cfgetospeed(&tio);
+        for (size_t i = 0; i < sizeof(SIMULATOR_BAUDS) / sizeof(SIMULATOR_BAUDS[0]); i++) {
+            if (SIMULATOR_BAUDS[i].speed == speed) return SIMULATOR_BAUDS[i].baud;
+        }
+        return 0;
+    }
+
+    // 两端速率不一致时收到的都是乱码
+    void Garble(uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; i++) data[i] = static_cast<uint8_t>(noise());
+    }
+
+    // 把输出缓冲写到主端
+    bool Flush(Clock::time_point now, int baud, bool garbled) {
+        size_t pending = output.size() - outputSent;
+        if (pending == 0) {
+            output.clear();
+            outputSent = 0;
+            return false;
+        }
+        pending = txLine.Available(now, baud, pending);
+        if (pending == 0) return false;
+        const uint8_t* data = output.data() + outputSent;
+        if (garbled) {
+            garbledOutput.assign(data, data + pending);
+            Garble(garbledOutput.data(), pending);
+            data = garbledOutput.data();
+        }
+        ssize_t n = write(master, data, pending);
+        if (n <= 0) return false;
+        outputSent += n;
+        txLine.Use(n);
+        // 线路一直占满时缓冲区不会写空，定期丢掉已写出的部分
+        if (outputSent >= 65536) {
+            output.erase(output.begin(), output.begin() + outputSent);
+            outputSent = 0;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.bytesOut += n;
+        return true;
+    }
+
+    // 接收线程中执行：处理一条主机命令，应答按设定的延迟排队
+    void OnCommand(const BatteryFrame& frame) {
+        std::vector<uint8_t> reply(1, CMD_STATUS_OK);
+        const uint8_t* p = frame.data;
+        size_t length = frame.length;
+        Response r;
+        r.switchBaud = 0;
+        r.idleMs = 0;
+        lastActivity = Clock::now();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.commandsHandled++;
+        switch (frame.type) {
+            case CMD_RESET:
+            case CMD_CALIBRATE:
+            case CMD_TOLERATE:
+            case CMD_CLEAN:
+                break;
+            case CMD_SET_SN:
+                if (length < TELEMETRY_SN_SIZE) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                serialNumber.assign(reinterpret_cast<const char*>(p), strnlen(reinterpret_cast<const char*>(p), TELEMETRY_SN_SIZE));
+                break;
+            case CMD_SET_BAUD: {
+                int baud = length >= 6 ? static_cast<int>(GetLe32(p)) : 0;
+                if (length < 6 || baud > maxBaud || !IsSupportedBaud(baud)) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                r.switchBaud = baud;
+                r.idleMs = GetLe16(p + 4);
+                break;
+            }
+            case CMD_LINK_PROBE:
+                reply.insert(reply.end(), p, p + length);
+                break;
+            case CMD_OTA_BEGIN:
+                if (length < 6 || GetLe32(p) > flash.size()) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                ota.assign(GetLe32(p), 0xFF);
+                break;
+            case CMD_OTA_DATA: {
+                uint32_t offset = length >= 4 ? GetLe32(p) : 0;
+                if (length < 4 || offset + (length - 4) > ota.size()) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                memcpy(&ota[offset], p + 4, length - 4);
+                break;
+            }
+            case CMD_OTA_END:
+                if (!VerifyOta()) reply[0] = CMD_STATUS_FAILED;
+                break;
+            case CMD_FLASH_CRC: {
+                if (length < 8) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                uint32_t address = GetLe32(p);
+                uint16_t blockSize = GetLe16(p + 4);
+                uint16_t count = GetLe16(p + 6);
+                if (blockSize == 0 || address + static_cast<size_t>(blockSize) * count > flash.size()) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                for (uint16_t i = 0; i < count; i++) {
+                    PutLe32(reply, crc32(&flash[address + i * blockSize], blockSize, 0xFFFFFFFF));
+                }
+                break;
+            }
+            case CMD_FLASH_BLOCK: {
+                uint32_t address = length >= 4 ? GetLe32(p) : 0;
+                if (length < 4 || address + (length - 4) > flash.size()) {
+                    reply[0] = CMD_STATUS_FAILED;
+                    break;
+                }
+                memcpy(&flash[address], p + 4, length - 4);
+                break;
+            }
+            default:
+                reply[0] = CMD_STATUS_FAILED;
+                break;
+        }
+
+        r.due = Clock::now() + std::chrono::milliseconds(faults.responseDelayMs);
+        AppendFrame(frame.type | FRAME_TYPE_RESPONSE, frame.seq, reply, r.bytes);
+        responses.push_back(r);
+    }
+
+    static bool IsSupportedBaud(int baud) {
+        for (size_t i = 0; i < sizeof(SIMULATOR_BAUDS) / sizeof(SIMULATOR_BAUDS[0]); i++) {
+            if (SIMULATOR_BAUDS[i].baud == baud) return true;
+        }
+        return false;
+    }
+
+    // 持锁调用：校验 OTA 镜像尾部的长度和 CRC32
+    bool VerifyOta() {
+        if (ota.size() < OTA_TRAILER_SIZE) return false;
+        const uint8_t* t = ota.data() + ota.size() - OTA_TRAILER_SIZE;
+        if (GetLe32(t) != OTA_MAGIC1 || GetLe32(t + 4) != OTA_MAGIC2 ||
+            GetLe32(t + 16) != OTA_MAGIC2 || GetLe32(t + 20) != OTA_MAGIC1) return false;
+        uint32_t size = GetLe32(t + 8);
+        if (size != ota.size() - OTA_TRAILER_SIZE) return false;
+        return crc32(ota.data(), size, 0xFFFFFFFF) == GetLe32(t + 12);
+    }
+
+    FrameMode mode;
+    FrameDecoder* decoder;
+    int master;
+    std::string slaveName;
+    std::string link;
+
+    std::thread* thread;
+    std::atomic<bool> running;
+    std::mutex mutex;
+
+    // 以下由 mutex 保护
+    double telemetryRate;
+    uint64_t rateSent;
+    Clock::time_point rateStart;
+    int baudRate;
+    int disconnectMs;
+    SimulatorFaults faults;
+    SimulatorStats stats;
+    std::vector<uint8_t> flash;
+    std::vector<uint8_t> ota;
+    std::string serialNumber;
+    std::mt19937 rng;
+    int maxBaud;
+
+    // 以下只在设备线程中使用
+    std::vector<uint8_t> output;
+    size_t outputSent;
+    std::deque<Response> responses;
+    Clock::time_point startTime;
+    LineBudget rxLine;
+    LineBudget txLine;
+    std::minstd_rand noise;
+    std::vector<uint8_t> garbledOutput;
+
+    // 线路速率协商状态，只在设备线程中使用
+    int lineBaud;               // 0 表示还没有协商过，跟随主机的设置
+    int powerOnBaud;
+    int pendingBaud;            // 切换应答已排队，发完后切换
+    int pendingIdleMs;
+    int revertIdleMs;
+    Clock::time_point lastActivity;
+};
@@ -0,0 +1,46 @@
+// battery_telemetry.h
+// 遥测最新值快照：接收线程以设备速率写入，界面线程按固定节拍轮询
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include "battery_protocol.h"
+
+class TelemetrySnapshot {
+public:
+    TelemetrySnapshot() : version(0), received(0) {
+        memset(&latest, 0, sizeof(latest));
+    }
+
+    // 接收线程调用：只覆盖最新值，不产生任何界面事件
+    void Update(const TelemetryRecord& rec) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            latest = rec;
+        }
+        received.fetch_add(1, std::memory_order_relaxed);
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    // 界面线程调用：自上次读取后没有新数据时返回 false，不加锁
+    bool Fetch(uint32_t& lastVersion, TelemetryRecord& rec) {
+        uint32_t v = version.load(std::memory_order_acquire);
+        if (v == lastVersion) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            rec = latest;
+        }
+        lastVersion = v;
+        return true;
+    }
+
+    // 累计收到的遥测帧数
+    uint32_t GetReceived() const { return received.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex;
+    TelemetryRecord latest;
+    std::atomic<uint32_t> version;
+    std::atomic<uint32_t> received;
+};
@@ -0,0 +1,167 @@
+// battsim.cpp
+// 虚拟电池设备命令行工具：创建一个伪终端，串口工具打开打印出来的设备名即可
+//
+// 用法：battsim [-m cobs|slip|length] [-r 频率|max] [-b 波特率] [-l 链接路径]
+//              [--corrupt 概率] [--garbage 概率] [--delay 毫秒]
+//              [--max-baud 波特率] [--reliable-baud 波特率] [-s 脚本文件]
+//
+// 脚本每行一条命令，# 开头为注释；没有 -s 时从标准输入逐行读取：
+//   rate <帧/秒|max>    遥测频率，max 为一直发到线路占满
+//   baud <波特率>        按波特率限速，0 不限速
+//   corrupt <概率>       每帧被改坏一个字节的概率
+//   garbage <概率>       帧前插入垃圾字节的概率
+//   delay <毫秒>         命令应答延迟
+//   maxbaud <波特率>     速率协商能切换到的最高速率
+//   reliable <波特率>    线路速率高于此值时收发都是乱码，0 不限
+//   disconnect <毫秒>    断开，指定时间后以新的伪终端重新上线
+//   wait [秒]            等待，不带参数一直等到 Ctrl+C
+//   stats                打印统计
+//   quit                 退出
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "battery_simulator.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void OnSignal(int) {
+    interrupted = 1;
+}
+
+static void PrintStats(BatterySimulator& sim) {
+    SimulatorStats s = sim.GetStats();
+    printf("telemetry %llu, commands %llu, corrupted %llu, garbage %llu bytes, out %llu bytes, in %llu bytes, disconnects %u, "
+           "baud %d (%u changes, %u reverts), sn %s\n",
+           (unsigned long long)s.telemetrySent, (unsigned long long)s.commandsHandled,
+           (unsigned long long)s.corruptedFrames, (unsigned long long)s.garbageBytes,
+           (unsigned long long)s.bytesOut, (unsigned long long)s.bytesIn, s.disconnects,
+           s.lineBaud, s.baudChanges, s.baudReverts, sim.GetSerialNumber().c_str());
+    fflush(stdout);
+}
+
+static double ParseRate(const std::string& text) {
+    return text == "max" ? -1 : atof(text.c_str());
+}
+
+static void Wait(double seconds) {
+    std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000));
+    while (!interrupted && (seconds < 0 || std::chrono::steady_clock::now() < due)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
+// 执行一条命令，返回 false 表示退出
+static bool RunCommand(BatterySimulator& sim, SimulatorFaults& faults, const std::string& line) {
+    std::istringstream in(line);
+    std::string command, arg;
+    in >> command >> arg;
+    if (command.empty() || command[0] == '#') return true;
+
+    if (command == "rate") {
+        sim.SetTelemetryRate(ParseRate(arg));
+    } else if (command == "baud") {
+        sim.SetBaudRate(atoi(arg.c_str()));
+    } else if (command == "corrupt") {
+        faults.corruptRate = atof(arg.c_str());
+        sim.SetFaults(faults);
+    } else if (command == "garbage") {
+        faults.garbageRate = atof(arg.c_str());
+        sim.SetFaults(faults);
+    } else if (command == "delay") {
+        faults.responseDelayMs = atoi(arg.c_str());
+        sim.SetFaults(faults);
+    } else if (command == "maxbaud") {
+        sim.SetMaxBaudRate(atoi(arg.c_str()));
+    } else if (command == "reliable") {
+        faults.maxReliableBaud = atoi(arg.c_str());
+        sim.SetFaults(faults);
+    } else if (command == "disconnect") {
+        sim.Disconnect(atoi(arg.c_str()));
+    } else if (command == "wait") {
+        Wait(arg.empty() ? -1 : atof(arg.c_str()));
+    } else if (command == "stats") {
+        PrintStats(sim);
+    } else if (command == "quit") {
+        return false;
+    } else {
+        fprintf(stderr, "Unknown command: %s\n", command.c_str());
+    }
+    return !interrupted;
+}
+
+int main(int argc, char** argv) {
+    FrameMode mode = FRAME_COBS;
+    double rate = 10;
+    int baud = 0;
+    int maxBaud = 3000000;
+    std::string linkPath, scriptPath;
+    SimulatorFaults faults = {};
+
+    for (int i = 1; i < argc; i++) {
+        std::string opt = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt.c_str());
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (opt == "-m") {
+            if (!ParseFrameMode(value, mode)) {
+                fprintf(stderr, "Unknown framing: %s\n", value.c_str());
+                return 2;
+            }
+        } else if (opt == "-r") rate = ParseRate(value);
+        else if (opt == "-b") baud = atoi(value.c_str());
+        else if (opt == "-l") linkPath = value;
+        else if (opt == "-s") scriptPath = value;
+        else if (opt == "--corrupt") faults.corruptRate = atof(value.c_str());
+        else if (opt == "--garbage") faults.garbageRate = atof(value.c_str());
+        else if (opt == "--delay") faults.responseDelayMs = atoi(value.c_str());
+        else if (opt == "--max-baud") maxBaud = atoi(value.c_str());
+        else if (opt == "--reliable-baud") faults.maxReliableBaud = atoi(value.c_str());
+        else {
+            fprintf(stderr, "Unknown option: %s\n", opt.c_str());
+            return 2;
+        }
+    }
+
+    // 不自动重启被中断的读，Ctrl+C 时等待标准输入的 getline 也能返回
+    struct sigaction action = {};
+    action.sa_handler = OnSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    BatterySimulator sim(mode);
+    std::string error;
+    if (!sim.Open(linkPath, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    sim.SetTelemetryRate(rate);
+    sim.SetBaudRate(baud);
+    sim.SetFaults(faults);
+    sim.SetMaxBaudRate(maxBaud);
+    sim.Start();
+    printf("%s\n", sim.GetPortName().c_str());
+    fflush(stdout);
+
+    std::string line;
+    if (!scriptPath.empty()) {
+        std::ifstream script(scriptPath.c_str());
+        if (!script) {
+            fprintf(stderr, "Failed to open script: %s\n", scriptPath.c_str());
+            return 1;
+        }
+        while (std::getline(script, line) && RunCommand(sim, faults, line)) {}
+    } else {
+        while (std::getline(std::cin, line) && RunCommand(sim, faults, line)) {}
+    }
+
+    sim.Stop();
+    PrintStats(sim);
+    return 0;
+}
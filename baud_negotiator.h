@@ -0,0 +1,192 @@
+// baud_negotiator.h
+// 批量传输前与设备协商更高的线路速率，传输结束后回到原速率
+//
+// 从最高的候选速率开始：用原速率发 CMD_SET_BAUD，设备应答后双方切换，
+// 再用 CMD_LINK_PROBE 发一段包含各种分隔符和转义字节的数据，原样带回才算切换成功。
+// 探测失败时主机先回到原速率，设备在 idleMs 内收不到有效帧也会自己回去，
+// 用原速率探测到设备后再试下一个较低的速率。
+// 全部由命令应答驱动，不阻塞接收线程，也不需要单独的线程。
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <functional>
+#include "command_engine.h"
+
+class BaudNegotiator {
+public:
+    // 切换主机侧串口波特率，主机不支持时返回 false
+    typedef std::function<bool(int baud)> RateSetter;
+    // ok 为 false 表示原速率下设备也没有应答，或者连接已关闭（主机侧已回到原速率）；baud 为当前线路速率
+    typedef std::function<void(bool ok, int baud, const std::string& message)> DoneHandler;
+
+    static const int DEFAULT_IDLE_MS = 500;
+    static const size_t PROBE_SIZE = 64;
+
+    BaudNegotiator(CommandEngine* engine, const RateSetter& setRate, int baseBaud)
+        : engine(engine), setRate(setRate), baseBaud(baseBaud), currentBaud(baseBaud),
+          idleMs(DEFAULT_IDLE_MS), next(0) {
+        static const int rates[] = { 3000000, 2000000, 1500000, 1000000, 921600, 460800, 230400 };
+        candidates.assign(rates, rates + sizeof(rates) / sizeof(rates[0]));
+
+        // 覆盖各分帧方式的分隔符、转义字节和交替位型，其余为变化的字节
+        static const uint8_t special[] = { 0x00, 0xFF, 0x55, 0xAA, 0xC0, 0xDB, 0xDC, 0xDD };
+        for (size_t i = 0; i < PROBE_SIZE; i++) {
+            probe.push_back(i < sizeof(special) ? special[i] : static_cast<uint8_t>(i * 37 + 11));
+        }
+    }
+
+    // 候选速率，从高到低尝试，不高于原速率的会被跳过
+    void SetCandidates(const std::vector<int>& rates) { candidates = rates; }
+    // 去掉不低于 baud 的候选速率：在这个速率下传输失败后，下次 Raise 从下一档开始
+    void LimitBelow(int baud) {
+        std::vector<int> lower;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (candidates[i] < baud) lower.push_back(candidates[i]);
+        }
+        candidates.swap(lower);
+    }
+    // 设备在新速率下空闲多久后自行回到原速率
+    void SetIdleTimeout(int ms) { idleMs = ms; }
+
+    int GetBaudRate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return currentBaud;
+    }
+    int GetBaseBaudRate() const { return baseBaud; }
+
+    // 协商尽可能高的速率，结果通过 done 通知；没有可用的更高速率时停在原速率，ok 仍为 true
+    void Raise(const DoneHandler& done) {
+        onDone = done;
+        next = 0;
+        TryNext();
+    }
+
+    // 回到原速率；设备没有收到切换命令也会在空闲后自行回去
+    void Restore(const DoneHandler& done) {
+        onDone = done;
+        int baud = GetBaudRate();
+        if (baud == baseBaud) {
+            Done(true, "Link at " + std::to_string(baseBaud) + " baud");
+            return;
+        }
+        engine->Submit(CMD_SET_BAUD, SetBaudPayload(baseBaud, 0), [this](const CommandResult& r) {
+            if (r.status == CMD_STATUS_CANCELLED) {
+                Closed();
+                return;
+            }
+            // 应答丢失时设备可能还在高速率，主机照样切回，由确认探测等设备超时回来
+            SwitchHost(baseBaud);
+            ConfirmBase([this]() {
+                Done(true, "Link back at " + std::to_string(baseBaud) + " baud");
+            });
+        }, 300, 1);
+    }
+
+private:
+    static std::vector<uint8_t> SetBaudPayload(int baud, int idle) {
+        std::vector<uint8_t> payload;
+        PutLe32(payload, static_cast<uint32_t>(baud));
+        PutLe16(payload, static_cast<uint16_t>(idle));
+        return payload;
+    }
+
+    void TryNext() {
+        while (next < candidates.size() && candidates[next] <= baseBaud) next++;
+        if (next >= candidates.size()) {
+            Done(true, "No faster rate available, staying at " + std::to_string(baseBaud) + " baud");
+            return;
+        }
+        int baud = candidates[next++];
+        engine->Submit(CMD_SET_BAUD, SetBaudPayload(baud, idleMs), [this, baud](const CommandResult& r) {
+            OnSetBaud(r, baud);
+        }, 300, 1);
+    }
+
+    void OnSetBaud(const CommandResult& r, int baud) {
+        if (r.status == CMD_STATUS_CANCELLED) {
+            Closed();
+            return;
+        }
+        if (r.status == CMD_STATUS_FAILED) {
+            // 设备不支持这个速率，没有切换
+            TryNext();
+            return;
+        }
+        if (r.status != CMD_STATUS_OK) {
+            // 没有应答：设备可能已经切换，按探测失败处理
+            FallBack();
+            return;
+        }
+        if (!SwitchHost(baud)) {
+            FallBack();
+            return;
+        }
+        // 设备发完应答才切换，第一次探测可能赶在它前面，留两次重试
+        engine->Submit(CMD_LINK_PROBE, probe, [this, baud](const CommandResult& r) {
+            if (r.status == CMD_STATUS_CANCELLED) {
+                Closed();
+            } else if (r.status == CMD_STATUS_OK && r.response == probe) {
+                Done(true, "Link at " + std::to_string(baud) + " baud");
+            } else {
+                FallBack();
+            }
+        }, 100, 2);
+    }
+
+    // 主机回到原速率，等设备也回来后试下一个速率
+    void FallBack() {
+        SwitchHost(baseBaud);
+        ConfirmBase([this]() { TryNext(); });
+    }
+
+    // 用原速率探测，直到设备空闲超时回到原速率
+    void ConfirmBase(const std::function<void()>& then) {
+        int retries = idleMs / 200 + 3;
+        engine->Submit(CMD_LINK_PROBE, probe, [this, then](const CommandResult& r) {
+            if (r.status == CMD_STATUS_CANCELLED) {
+                Closed();
+            } else if (r.status == CMD_STATUS_OK && r.response == probe) {
+                then();
+            } else {
+                Done(false, "Device not responding at " + std::to_string(baseBaud) + " baud");
+            }
+        }, 200, retries);
+    }
+
+    bool SwitchHost(int baud) {
+        bool ok = setRate(baud);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok) currentBaud = baud;
+        return ok;
+    }
+
+    // 命令被取消（连接关闭或任务中止），不再等设备；串口已关闭时切换会失败，也按原速率算
+    void Closed() {
+        setRate(baseBaud);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentBaud = baseBaud;
+        }
+        Done(false, "Link closed");
+    }
+
+    void Done(bool ok, const std::string& message) {
+        DoneHandler done;
+        done.swap(onDone);
+        if (done) done(ok, GetBaudRate(), message);
+    }
+
+    CommandEngine* engine;
+    RateSetter setRate;
+    int baseBaud;
+    std::mutex mutex;
+    int currentBaud;
+    int idleMs;
+    std::vector<int> candidates;
+    size_t next;
+    std::vector<uint8_t> probe;
+    DoneHandler onDone;
+};
@@ -0,0 +1,462 @@
+// capture_file.h
+// 串口收发数据抓包文件：只追加写入，内存映射，带定期的跳转索引
+//
+// 文件格式（小端）：
+//   文件头 32 字节：magic "WXCAPTR1" | 开始时间（纪元纳秒）u64 | 文件头长度 u32 | 保留
+//   记录：时间（相对开始的纳秒）u64 | 长度 u16 | 方向 u8 | 保留 u8 | 数据
+//   正常关闭时在末尾追加索引：每 64KB 数据一条 {时间 u64, 偏移 u64}，
+//   最后 16 字节是 {索引偏移 u64, 索引条数 u32, "CIDX"}。
+// 程序崩溃没有写索引时，读取端按记录顺序扫描重建索引。
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+enum CaptureDirection {
+    CAPTURE_RX = 1,
+    CAPTURE_TX = 2
+};
+
+static const char CAPTURE_MAGIC[8] = { 'W', 'X', 'C', 'A', 'P', 'T', 'R', '1' };
+static const uint32_t CAPTURE_INDEX_MAGIC = 0x58444943;   // "CIDX"
+static const size_t CAPTURE_HEADER_SIZE = 32;
+static const size_t CAPTURE_RECORD_HEADER = 12;
+static const size_t CAPTURE_TRAILER_SIZE = 16;
+static const size_t CAPTURE_INDEX_INTERVAL = 64 * 1024;   // 每隔多少字节记一条索引
+static const size_t CAPTURE_MAP_WINDOW = 16 * 1024 * 1024; // 每次映射/扩展文件的大小
+
+// 读出的一条记录，data 直接指向映射内存
+struct CaptureRecord {
+    uint64_t time;          // 相对抓包开始的纳秒
+    int direction;          // CaptureDirection
+    const uint8_t* data;
+    size_t length;
+};
+
+inline void StoreLe16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+inline void StoreLe32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (i * 8));
+}
+
+inline void StoreLe64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = static_cast<uint8_t>(v >> (i * 8));
+}
+
+inline uint64_t LoadLe64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint32_t LoadLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// 抓包写入。多个线程（接收、发送）可以同时调用 Append
+class CaptureWriter {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    CaptureWriter() : view(nullptr), viewOffset(0), fileSize(0), length(0), lastIndexed(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~CaptureWriter() { Close(); }
+
+    bool Open(const std::string& path, std::string& error) {
+        Close();
+        std::lock_guard<std::mutex> lock(mutex);
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "Failed to create capture file: " + path + "\nError code: " + std::to_string(GetLastError());
+            return false;
+        }
+#else
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            error = "Failed to create capture file: " + path + "\nError: " + strerror(errno);
+            return false;
+        }
+#endif
+        fileSize = 0;
+        length = 0;
+        viewOffset = 0;
+        index.clear();
+        if (!MapWindow(0)) {
+            error = "Failed to map capture file: " + path;
+            CloseFile();
+            return false;
+        }
+
+        uint8_t header[CAPTURE_HEADER_SIZE] = {0};
+        memcpy(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+        uint64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        StoreLe64(header + 8, wall);
+        StoreLe32(header + 16, CAPTURE_HEADER_SIZE);
+        Put(header, sizeof(header));
+
+        startTime = Clock::now();
+        lastIndexed = length;
+        index.push_back(IndexEntry(0, length));
+        return true;
+    }
+
+    // 写索引和尾部，把文件截到实际长度
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!view) return;
+
+        uint64_t indexOffset = length;
+        for (size_t i = 0; i < index.size(); i++) {
+            uint8_t entry[16];
+            StoreLe64(entry, index[i].time);
+            StoreLe64(entry + 8, index[i].offset);
+            Put(entry, sizeof(entry));
+        }
+        uint8_t trailer[CAPTURE_TRAILER_SIZE];
+        StoreLe64(trailer, indexOffset);
+        StoreLe32(trailer + 8, static_cast<uint32_t>(index.size()));
+        StoreLe32(trailer + 12, CAPTURE_INDEX_MAGIC);
+        Put(trailer, sizeof(trailer));
+
+        Unmap();
+        Resize(length);
+        CloseFile();
+    }
+
+    bool IsOpen() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return view != nullptr;
+    }
+
+    void Append(int direction, const uint8_t* data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!view) return;
+        uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - startTime).count();
+
+        // 单条记录长度只有 16 位，超长的数据拆成多条
+        while (size > 0) {
+            size_t chunk = size > 0xFFFF ? 0xFFFF : size;
+            if (length - lastIndexed >= CAPTURE_INDEX_INTERVAL) {
+                index.push_back(IndexEntry(now, length));
+                lastIndexed = length;
+            }
+            uint8_t header[CAPTURE_RECORD_HEADER];
+            StoreLe64(header, now);
+            StoreLe16(header + 8, static_cast<uint16_t>(chunk));
+            header[10] = static_cast<uint8_t>(direction);
+            header[11] = 0;
+            if (!Put(header, sizeof(header)) || !Put(data, chunk)) return;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    // 已写入的字节数（含文件头）
+    uint64_t GetBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return length;
+    }
+
+private:
+    struct IndexEntry {
+        IndexEntry(uint64_t t, uint64_t o) : time(t), offset(o) {}
+        uint64_t time;
+        uint64_t offset;
+    };
+
+    // 持锁调用：写到映射窗口，窗口写满时扩展文件并映射下一段
+    bool Put(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            size_t pos = static_cast<size_t>(length - viewOffset);
+            if (pos >= CAPTURE_MAP_WINDOW) {
+                if (!MapWindow(viewOffset + CAPTURE_MAP_WINDOW)) {
+                    // 磁盘满等情况：停止抓包，已写入的部分仍然可读
+                    Unmap();
+                    Resize(length);
+                    CloseFile();
+                    return false;
+                }
+                pos = 0;
+            }
+            size_t n = CAPTURE_MAP_WINDOW - pos < size ? CAPTURE_MAP_WINDOW - pos : size;
+            memcpy(view + pos, data, n);
+            length += n;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool MapWindow(uint64_t offset) {
+        Unmap();
+        if (!Resize(offset + CAPTURE_MAP_WINDOW)) return false;
+#ifdef _WIN32
+        mapping = CreateFileMappingA(file, 0, PAGE_READWRITE,
+                                     static_cast<DWORD>(fileSize >> 32), static_cast<DWORD>(fileSize), 0);
+        if (!mapping) return false;
+        view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE,
+                                                   static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset),
+                                                   CAPTURE_MAP_WINDOW));
+        if (!view) {
+            CloseHandle(mapping);
+            return false;
+        }
+#else
+        void* p = mmap(0, CAPTURE_MAP_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(offset));
+        if (p == MAP_FAILED) return false;
+        view = static_cast<uint8_t*>(p);
+#endif
+        viewOffset = offset;
+        return true;
+    }
+
+    void Unmap() {
+        if (!view) return;
+#ifdef _WIN32
+        UnmapViewOfFile(view);
+        CloseHandle(mapping);
+#else
+        munmap(view, CAPTURE_MAP_WINDOW);
+#endif
+        view = nullptr;
+    }
+
+    bool Resize(uint64_t size) {
+#ifdef _WIN32
+        LARGE_INTEGER pos;
+        pos.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file, pos, 0, FILE_BEGIN) || !SetEndOfFile(file)) return false;
+#else
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) return false;
+#endif
+        fileSize = size;
+        return true;
+    }
+
+    void CloseFile() {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    std::mutex mutex;
+    uint8_t* view;
+    uint64_t viewOffset;
+    uint64_t fileSize;
+    uint64_t length;
+    uint64_t lastIndexed;
+    Clock::time_point startTime;
+    std::vector<IndexEntry> index;
+};
+
+// 抓包读取：整个文件只读映射，记录数据不拷贝
+class CaptureReader {
+public:
+    CaptureReader() : base(nullptr), size(0), dataEnd(0), position(0), startWallTime(0), duration(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = 0;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~CaptureReader() { Close(); }
+
+    bool Open(const std::string& path, std::string& error) {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+            error = "Failed to open capture file: " + path;
+            Close();
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+        if (size >= CAPTURE_HEADER_SIZE) {
+            mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+            if (mapping) base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            error = "Failed to open capture file: " + path + "\nError: " + strerror(errno);
+            Close();
+            return false;
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size >= CAPTURE_HEADER_SIZE) {
+            void* p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) base = static_cast<const uint8_t*>(p);
+        }
+#endif
+        if (!base || memcmp(base, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+            error = "Not a capture file: " + path;
+            Close();
+            return false;
+        }
+        startWallTime = LoadLe64(base + 8);
+        LoadIndex();
+        Rewind();
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = 0;
+#else
+        if (base) munmap(const_cast<uint8_t*>(base), size);
+        if (fd >= 0) close(fd);
+        fd = -1;
+#endif
+        base = nullptr;
+        size = 0;
+        index.clear();
+    }
+
+    void Rewind() { position = CAPTURE_HEADER_SIZE; }
+
+    // 读下一条记录，到结尾返回 false
+    bool Next(CaptureRecord& rec) {
+        if (!ParseAt(position, rec)) return false;
+        position += CAPTURE_RECORD_HEADER + rec.length;
+        return true;
+    }
+
+    // 跳到第一条时间不早于 time 的记录：先按索引二分，再顺序扫描
+    void Seek(uint64_t time) {
+        std::vector<IndexEntry>::const_iterator it = std::upper_bound(index.begin(), index.end(), time,
+            [](uint64_t t, const IndexEntry& e) { return t < e.time; });
+        position = it == index.begin() ? CAPTURE_HEADER_SIZE : (it - 1)->offset;
+        CaptureRecord rec;
+        while (ParseAt(position, rec) && rec.time < time) {
+            position += CAPTURE_RECORD_HEADER + rec.length;
+        }
+    }
+
+    uint64_t GetDuration() const { return duration; }
+    uint64_t GetStartWallTime() const { return startWallTime; }
+
+private:
+    struct IndexEntry {
+        uint64_t time;
+        uint64_t offset;
+    };
+
+    bool ParseAt(uint64_t offset, CaptureRecord& rec) const {
+        if (offset + CAPTURE_RECORD_HEADER > dataEnd) return false;
+        const uint8_t* p = base + offset;
+        rec.time = LoadLe64(p);
+        rec.length = p[8] | (p[9] << 8);
+        rec.direction = p[10];
+        rec.data = p + CAPTURE_RECORD_HEADER;
+        // 崩溃时文件末尾是扩展出来的 0，方向无效即视为结束
+        if (rec.direction != CAPTURE_RX && rec.direction != CAPTURE_TX) return false;
+        return offset + CAPTURE_RECORD_HEADER + rec.length <= dataEnd;
+    }
+
+    // 读尾部索引；没有（写入时崩溃）则扫描全部记录重建
+    void LoadIndex() {
+        index.clear();
+        dataEnd = size;
+        uint64_t scanFrom = CAPTURE_HEADER_SIZE;
+        if (size >= CAPTURE_HEADER_SIZE + CAPTURE_TRAILER_SIZE) {
+            const uint8_t* trailer = base + size - CAPTURE_TRAILER_SIZE;
+            uint64_t indexOffset = LoadLe64(trailer);
+            uint32_t count = LoadLe32(trailer + 8);
+            if (LoadLe32(trailer + 12) == CAPTURE_INDEX_MAGIC && indexOffset >= CAPTURE_HEADER_SIZE &&
+                indexOffset + count * 16ULL + CAPTURE_TRAILER_SIZE == size) {
+                dataEnd = indexOffset;
+                for (uint32_t i = 0; i < count; i++) {
+                    IndexEntry e;
+                    e.time = LoadLe64(base + indexOffset + i * 16);
+                    e.offset = LoadLe64(base + indexOffset + i * 16 + 8);
+                    index.push_back(e);
+                }
+                if (!index.empty()) scanFrom = index.back().offset;
+            }
+        }
+
+        // 从最后一条索引往后扫，得到总时长；没有索引时顺便重建
+        bool rebuild = index.empty();
+        uint64_t lastIndexed = 0;
+        uint64_t offset = scanFrom;
+        CaptureRecord rec;
+        duration = 0;
+        while (ParseAt(offset, rec)) {
+            if (rebuild && (index.empty() || offset - lastIndexed >= CAPTURE_INDEX_INTERVAL)) {
+                IndexEntry e;
+                e.time = rec.time;
+                e.offset = offset;
+                index.push_back(e);
+                lastIndexed = offset;
+            }
+            duration = rec.time;
+            offset += CAPTURE_RECORD_HEADER + rec.length;
+        }
+        if (rebuild) dataEnd = offset;
+    }
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    const uint8_t* base;
+    size_t size;
+    uint64_t dataEnd;
+    uint64_t position;
+    uint64_t startWallTime;
+    uint64_t duration;
+    std::vector<IndexEntry> index;
+};
@@ -0,0 +1,315 @@
+// command_engine.h
+// 流水线式的请求/应答命令引擎
+//
+// 同时保持多条命令在途（滑动窗口），应答按 seq 与请求匹配，
+// 每条命令有独立的超时和重试次数。窗口满时新命令排队等待。
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include "frame_codec.h"
+#include "battery_protocol.h"
+
+// 命令执行结果
+struct CommandResult {
+    uint8_t command;
+    uint8_t seq;
+    int status;                     // CommandStatus
+    int attempts;                   // 实际发送次数
+    uint32_t tag;                   // 调用者自定义标记，原样带回
+    std::vector<uint8_t> response;  // 应答负载（不含状态字节）
+};
+
+class CommandEngine {
+public:
+    typedef std::function<bool(const std::vector<uint8_t>&)> Writer;
+    typedef std::function<void(const CommandResult&)> Completion;
+    typedef std::chrono::steady_clock Clock;
+
+    // writer 负责把编码好的帧写到串口，可能被多个线程调用
+    // ownTimer 为 false 时不创建超时线程，由调用者定期调用 CheckTimeouts（多端口共用线程时使用）
+    CommandEngine(FrameMode mode, const Writer& writer, size_t window = 8, bool ownTimer = true)
+        : mode(mode), writer(writer), window(window), nextSeq(0), running(true), timerThread(nullptr) {
+        if (ownTimer) {
+            timerThread = new std::thread(&CommandEngine::TimerThread, this);
+        }
+    }
+
+    ~CommandEngine() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_one();
+        if (timerThread) {
+            timerThread->join();
+            delete timerThread;
+        }
+        CancelAll();
+    }
+
+    // 提交一条命令，立即返回；完成、超时或取消时调用 done（在引擎或接收线程中）
+    // 引擎正在销毁时（如取消回调里又提交命令）直接以 cancelled 结束
+    // owner 标记命令的提交者，可以用 Cancel(owner) 只取消它自己的命令
+    void Submit(uint8_t command, const std::vector<uint8_t>& payload, const Completion& done,
+                int timeoutMs = 500, int retries = 3, uint32_t tag = 0, const void* owner = nullptr) {
+        Request req;
+        req.command = command;
+        req.seq = 0;
+        req.payload = payload;
+        req.done = done;
+        req.timeout = std::chrono::milliseconds(timeoutMs);
+        req.retries = retries;
+        req.attempts = 0;
+        req.tag = tag;
+        req.owner = owner;
+
+        std::vector<std::vector<uint8_t> > frames;
+        bool accepted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            accepted = running;
+            if (accepted) {
+                pending.push_back(req);
+                FillWindow(frames);
+            }
+        }
+        if (!accepted) {
+            if (done) done(MakeResult(req, CMD_STATUS_CANCELLED));
+            return;
+        }
+        condition.notify_one();
+        Transmit(frames);
+    }
+
+    // 接收线程调用：是应答帧且匹配到在途命令时返回 true
+    bool OnFrame(const BatteryFrame& frame) {
+        if (!(frame.type & FRAME_TYPE_RESPONSE)) return false;
+
+        Request req;
+        std::vector<std::vector<uint8_t> > frames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<uint8_t, Request>::iterator it = inFlight.find(frame.seq);
+            if (it == inFlight.end() || (it->second.command | FRAME_TYPE_RESPONSE) != frame.type) {
+                // 重传造成的重复应答，或与当前命令不符，直接丢弃
+                return true;
+            }
+            req = it->second;
+            inFlight.erase(it);
+            FillWindow(frames);
+        }
+        condition.notify_one();
+        Transmit(frames);
+
+        CommandResult result = MakeResult(req, frame.length > 0 ? static_cast<int>(frame.data[0])
+                                                                : static_cast<int>(CMD_STATUS_FAILED));
+        if (frame.length > 1) {
+            result.response.assign(frame.data + 1, frame.data + frame.length);
+        }
+        if (req.done) req.done(result);
+        return true;
+    }
+
+    // 取消所有排队和在途的命令
+    void CancelAll() {
+        std::vector<Request> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::map<uint8_t, Request>::iterator it = inFlight.begin(); it != inFlight.end(); ++it) {
+                cancelled.push_back(it->second);
+            }
+            cancelled.insert(cancelled.end(), pending.begin(), pending.end());
+            inFlight.clear();
+            pending.clear();
+        }
+        Complete(cancelled, CMD_STATUS_CANCELLED);
+    }
+
+    // 只取消 owner 提交的排队和在途命令，其他命令不受影响
+    void Cancel(const void* owner) {
+        std::vector<Request> cancelled;
+        std::vector<std::vector<uint8_t> > frames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<uint8_t, Request>::iterator it = inFlight.begin();
+            while (it != inFlight.end()) {
+                if (it->second.owner == owner) {
+                    cancelled.push_back(it->second);
+                    inFlight.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+            std::deque<Request>::iterator p = pending.begin();
+            while (p != pending.end()) {
+                if (p->owner == owner) {
+                    cancelled.push_back(*p);
+                    p = pending.erase(p);
+                } else {
+                    ++p;
+                }
+            }
+            // 腾出的窗口让给其他排队的命令
+            if (!cancelled.empty()) FillWindow(frames);
+        }
+        Transmit(frames);
+        Complete(cancelled, CMD_STATUS_CANCELLED);
+    }
+
+    // 调整窗口大小，批量传输时可以放大
+    void SetWindow(size_t w) {
+        std::vector<std::vector<uint8_t> > frames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            window = w < 1 ? 1 : (w > MAX_WINDOW ? MAX_WINDOW : w);
+            FillWindow(frames);
+        }
+        Transmit(frames);
+    }
+
+    size_t GetInFlight() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inFlight.size();
+    }
+
+    size_t GetPending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending.size();
+    }
+
+    // 累计重传次数
+    uint32_t GetRetransmits() const { return retransmits.load(); }
+
+    static const size_t MAX_WINDOW = 128;  // seq 只有 8 位，窗口不能超过一半
+
+private:
+    struct Request {
+        uint8_t command;
+        uint8_t seq;
+        std::vector<uint8_t> payload;
+        Completion done;
+        Clock::duration timeout;
+        Clock::time_point deadline;
+        int retries;
+        int attempts;
+        uint32_t tag;
+        const void* owner;
+    };
+
+    static void Complete(const std::vector<Request>& requests, int status) {
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (requests[i].done) requests[i].done(MakeResult(requests[i], status));
+        }
+    }
+
+    static CommandResult MakeResult(const Request& req, int status) {
+        CommandResult result;
+        result.command = req.command;
+        result.seq = req.seq;
+        result.status = status;
+        result.attempts = req.attempts;
+        result.tag = req.tag;
+        return result;
+    }
+
+    // 持锁调用：把排队的命令放进窗口，输出需要发送的帧
+    void FillWindow(std::vector<std::vector<uint8_t> >& frames) {
+        while (!pending.empty() && inFlight.size() < window) {
+            // 分配一个未被在途命令占用的 seq
+            while (inFlight.count(nextSeq)) nextSeq++;
+            Request req = pending.front();
+            pending.pop_front();
+            req.seq = nextSeq++;
+            frames.push_back(std::vector<uint8_t>());
+            Encode(req, frames.back());
+            inFlight[req.seq] = req;
+        }
+    }
+
+    // 持锁调用：记录一次发送并编码
+    void Encode(Request& req, std::vector<uint8_t>& out) {
+        req.attempts++;
+        req.deadline = Clock::now() + req.timeout;
+        EncodeFrame(mode, req.command, req.seq, req.payload.data(), req.payload.size(), out);
+    }
+
+    // 不持锁调用，避免写串口时阻塞接收线程匹配应答
+    void Transmit(const std::vector<std::vector<uint8_t> >& frames) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            writer(frames[i]);
+        }
+    }
+
+    // 超时检查线程：等到最近的截止时间，重发或放弃超时的命令
+    void TimerThread() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            Clock::time_point next = Clock::now() + std::chrono::milliseconds(100);
+            for (std::map<uint8_t, Request>::iterator it = inFlight.begin(); it != inFlight.end(); ++it) {
+                if (it->second.deadline < next) next = it->second.deadline;
+            }
+            condition.wait_until(lock, next);
+            if (!running) break;
+
+            lock.unlock();
+            CheckTimeouts();
+            lock.lock();
+        }
+    }
+
+public:
+    // 检查一次超时：重发未用尽重试的命令，放弃用尽的命令
+    void CheckTimeouts() {
+        std::vector<std::vector<uint8_t> > frames;
+        std::vector<Request> expired;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (inFlight.empty()) return;
+            Clock::time_point now = Clock::now();
+            std::map<uint8_t, Request>::iterator it = inFlight.begin();
+            while (it != inFlight.end()) {
+                Request& req = it->second;
+                if (req.deadline > now) {
+                    ++it;
+                } else if (req.attempts <= req.retries) {
+                    // 只重发超时的这一条，其他在途命令不受影响
+                    frames.push_back(std::vector<uint8_t>());
+                    Encode(req, frames.back());
+                    retransmits++;
+                    ++it;
+                } else {
+                    expired.push_back(req);
+                    inFlight.erase(it++);
+                }
+            }
+            if (!expired.empty()) FillWindow(frames);
+        }
+        Transmit(frames);
+        for (size_t i = 0; i < expired.size(); i++) {
+            if (expired[i].done) expired[i].done(MakeResult(expired[i], CMD_STATUS_TIMEOUT));
+        }
+    }
+
+private:
+    FrameMode mode;
+    Writer writer;
+    size_t window;
+    uint8_t nextSeq;
+    bool running;
+    std::atomic<uint32_t> retransmits{0};
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Request> pending;
+    std::map<uint8_t, Request> inFlight;
+    std::thread* timerThread;
+};
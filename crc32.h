@@ -0,0 +1,36 @@
+// crc32.h
+// CRC32 计算，合并工具和串口工具共用
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC32 查找表
+struct Crc32Table {
+    uint32_t entries[256];
+
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (uint32_t j = 0; j < 8; j++) {
+                if (crc & 1) {
+                    crc = (crc >> 1) ^ 0xEDB88320; // 反转多项式原始形式是0x04C11DB7
+                } else {
+                    crc >>= 1;
+                }
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+// 计算 CRC32
+// 工位工作线程、模拟器线程可能同时计算，查找表用局部静态对象初始化，所有翻译单元共用一份且只初始化一次
+inline uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc) {
+    static const Crc32Table table;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t byte = data[i];
+        crc = (crc >> 8) ^ table.entries[(crc ^ byte) & 0xFF];
+    }
+    return ~crc; // 取反
+}
@@ -0,0 +1,422 @@
+// frame_codec.h
+// 电池协议的二进制分帧层：COBS / SLIP / 长度前缀 三种分帧 + CRC-16 校验
+//
+// 帧体（解帧后）格式：
+//   [type:1][seq:1][data:n][crc16:2, 小端]
+//   crc16 为 CRC-16/CCITT-FALSE，覆盖 type..data
+//
+// 长度前缀分帧：[0xA5][0x5A][len:2, 小端][帧体:len]
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <functional>
+
+// 分帧方式，顺序与界面上的下拉框一致
+enum FrameMode {
+    FRAME_TEXT = 0,     // 不分帧，按 UTF-8 文本显示
+    FRAME_COBS,
+    FRAME_SLIP,
+    FRAME_LENGTH
+};
+
+// 单帧最大长度，超过则视为分帧错误并重新同步
+static const size_t FRAME_MAX_SIZE = 4096;
+
+// 帧体最短长度：type + seq + crc16
+static const size_t FRAME_MIN_SIZE = 4;
+
+// CRC-16/CCITT-FALSE 查找表
+struct Crc16Table {
+    uint16_t entries[256];
+
+    Crc16Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint16_t c = static_cast<uint16_t>(i << 8);
+            for (int j = 0; j < 8; j++) {
+                c = (c & 0x8000) ? static_cast<uint16_t>((c << 1) ^ 0x1021) : static_cast<uint16_t>(c << 1);
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+// CRC-16/CCITT-FALSE（多项式 0x1021，初值 0xFFFF）
+// 接收线程、工位工作线程会同时解码，查找表用局部静态对象初始化，C++11 起保证只初始化一次
+inline uint16_t crc16_ccitt(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+    static const Crc16Table table;
+    for (size_t i = 0; i < length; i++) {
+        crc = static_cast<uint16_t>((crc << 8) ^ table.entries[((crc >> 8) ^ data[i]) & 0xFF]);
+    }
+    return crc;
+}
+
+// 解出的一帧。data 指向解码器内部缓冲区或调用者的输入块，只在回调期间有效
+struct BatteryFrame {
+    uint8_t type;
+    uint8_t seq;
+    const uint8_t* data;
+    size_t length;
+};
+
+// 分帧解码器基类：按块喂入原始字节，跨块边界增量重同步
+class FrameDecoder {
+public:
+    typedef std::function<void(const BatteryFrame&)> FrameHandler;
+
+    FrameDecoder() : frameCount(0), crcErrors(0), framingErrors(0) {
+        frameBuf.reserve(FRAME_MAX_SIZE);
+    }
+    virtual ~FrameDecoder() {}
+
+    void SetHandler(const FrameHandler& h) { handler = h; }
+
+    // 喂入一块原始数据，可以是任意长度、任意切分
+    virtual void Feed(const uint8_t* data, size_t length) = 0;
+    // 丢弃未完成的帧，回到等待帧头状态
+    virtual void Reset() { frameBuf.clear(); }
+
+    uint32_t GetFrameCount() const { return frameCount; }
+    uint32_t GetCrcErrors() const { return crcErrors; }
+    uint32_t GetFramingErrors() const { return framingErrors; }
+
+protected:
+    // 校验帧体并交给下游，帧体可以直接指向输入块（零拷贝）
+    bool Deliver(const uint8_t* body, size_t length) {
+        if (length < FRAME_MIN_SIZE) {
+            framingErrors++;
+            return false;
+        }
+        uint16_t expect = static_cast<uint16_t>(body[length - 2] | (body[length - 1] << 8));
+        if (crc16_ccitt(body, length - 2) != expect) {
+            crcErrors++;
+            return false;
+        }
+        frameCount++;
+        if (handler) {
+            BatteryFrame frame;
+            frame.type = body[0];
+            frame.seq = body[1];
+            frame.data = body + 2;
+            frame.length = length - FRAME_MIN_SIZE;
+            handler(frame);
+        }
+        return true;
+    }
+
+    FrameHandler handler;
+    std::vector<uint8_t> frameBuf;   // 跨块未完成帧的暂存区
+    uint32_t frameCount;
+    uint32_t crcErrors;
+    uint32_t framingErrors;
+};
+
+// COBS 解码：0x00 为帧分隔符
+class CobsDecoder : public FrameDecoder {
+public:
+    CobsDecoder() : code(0xFF), remaining(0), firstBlock(true), discarding(false) {}
+
+    void Reset() {
+        FrameDecoder::Reset();
+        code = 0xFF;
+        remaining = 0;
+        firstBlock = true;
+        discarding = false;
+    }
+
+    void Feed(const uint8_t* data, size_t length) {
+        const uint8_t* p = data;
+        const uint8_t* end = data + length;
+
+        while (p < end) {
+            // 出错后丢弃到下一个分隔符
+            if (discarding) {
+                const uint8_t* z = static_cast<const uint8_t*>(memchr(p, 0, end - p));
+                if (!z) return;
+                p = z + 1;
+                Reset();
+                continue;
+            }
+
+            if (remaining == 0) {
+                uint8_t b = *p++;
+                if (b == 0) {
+                    // 分隔符：空帧直接忽略
+                    if (!frameBuf.empty()) {
+                        Deliver(frameBuf.data(), frameBuf.size());
+                    }
+                    Reset();
+                    continue;
+                }
+                // 上一个块不是满块时，块之间隐含一个 0x00
+                if (!firstBlock && code != 0xFF) {
+                    frameBuf.push_back(0);
+                }
+                code = b;
+                remaining = b - 1;
+                firstBlock = false;
+                continue;
+            }
+
+            // 块内数据整段拷贝，块内不应出现 0x00
+            size_t n = remaining;
+            if (n > static_cast<size_t>(end - p)) n = end - p;
+            const uint8_t* z = static_cast<const uint8_t*>(memchr(p, 0, n));
+            if (z) {
+                framingErrors++;
+                Reset();
+                p = z + 1;
+                continue;
+            }
+            if (frameBuf.size() + n > FRAME_MAX_SIZE) {
+                framingErrors++;
+                discarding = true;
+                p += n;
+                continue;
+            }
+            frameBuf.insert(frameBuf.end(), p, p + n);
+            p += n;
+            remaining -= n;
+        }
+    }
+
+private:
+    uint8_t code;
+    size_t remaining;
+    bool firstBlock;
+    bool discarding;
+};
+
+// SLIP 解码（RFC 1055）
+class SlipDecoder : public FrameDecoder {
+public:
+    enum { SLIP_END = 0xC0, SLIP_ESC = 0xDB, SLIP_ESC_END = 0xDC, SLIP_ESC_ESC = 0xDD };
+
+    SlipDecoder() : escaped(false), discarding(false) {}
+
+    void Reset() {
+        FrameDecoder::Reset();
+        escaped = false;
+        discarding = false;
+    }
+
+    void Feed(const uint8_t* data, size_t length) {
+        const uint8_t* p = data;
+        const uint8_t* end = data + length;
+
+        while (p < end) {
+            if (discarding) {
+                const uint8_t* e = static_cast<const uint8_t*>(memchr(p, SLIP_END, end - p));
+                if (!e) return;
+                p = e + 1;
+                Reset();
+                continue;
+            }
+
+            if (escaped) {
+                uint8_t b = *p++;
+                escaped = false;
+                if (b == SLIP_ESC_END) {
+                    Append(SLIP_END);
+                } else if (b == SLIP_ESC_ESC) {
+                    Append(SLIP_ESC);
+                } else {
+                    framingErrors++;
+                    discarding = (b != SLIP_END);
+                    FrameDecoder::Reset();
+                }
+                continue;
+            }
+
+            // 找到下一个特殊字节，中间的普通字节整段处理
+            const uint8_t* q = p;
+            while (q < end && *q != SLIP_END && *q != SLIP_ESC) q++;
+
+            if (q < end && *q == SLIP_END && frameBuf.empty()) {
+                // 整帧都在当前块内且没有转义：直接从输入块交付，不拷贝
+                if (q > p) Deliver(p, q - p);
+                p = q + 1;
+                continue;
+            }
+
+            if (q > p) {
+                if (frameBuf.size() + (q - p) > FRAME_MAX_SIZE) {
+                    framingErrors++;
+                    discarding = true;
+                    p = q;
+                    continue;
+                }
+                frameBuf.insert(frameBuf.end(), p, q);
+            }
+            p = q;
+            if (p == end) break;
+
+            if (*p == SLIP_END) {
+                if (!frameBuf.empty()) {
+                    Deliver(frameBuf.data(), frameBuf.size());
+                }
+                FrameDecoder::Reset();
+            } else {
+                escaped = true;
+            }
+            p++;
+        }
+    }
+
+private:
+    void Append(uint8_t b) {
+        if (frameBuf.size() >= FRAME_MAX_SIZE) {
+            framingErrors++;
+            discarding = true;
+            return;
+        }
+        frameBuf.push_back(b);
+    }
+
+    bool escaped;
+    bool discarding;
+};
+
+// 长度前缀解码：[0xA5][0x5A][len:2][帧体]
+class LengthDecoder : public FrameDecoder {
+public:
+    enum { SYNC1 = 0xA5, SYNC2 = 0x5A, HEADER_SIZE = 4 };
+
+    void Feed(const uint8_t* data, size_t length) {
+        // 补全暂存区里的半帧：每次只拷贝补全当前帧所需的字节
+        while (length > 0 && !frameBuf.empty()) {
+            size_t need = Needed();
+            size_t take = need < length ? need : length;
+            frameBuf.insert(frameBuf.end(), data, data + take);
+            data += take;
+            length -= take;
+            size_t used = Parse(frameBuf.data(), frameBuf.size());
+            frameBuf.erase(frameBuf.begin(), frameBuf.begin() + used);
+        }
+        if (length == 0) return;
+
+        // 完整的帧直接在输入块上解析，只把尾部半帧留下
+        size_t used = Parse(data, length);
+        frameBuf.assign(data + used, data + length);
+    }
+
+private:
+    // 暂存区里的半帧还差多少字节
+    size_t Needed() const {
+        if (frameBuf.size() < HEADER_SIZE) return HEADER_SIZE - frameBuf.size();
+        size_t bodyLen = frameBuf[2] | (frameBuf[3] << 8);
+        return HEADER_SIZE + bodyLen - frameBuf.size();
+    }
+
+    // 解析尽可能多的完整帧，返回已消费的字节数；剩余部分从同步头开始
+    size_t Parse(const uint8_t* buf, size_t length) {
+        size_t pos = 0;
+        while (pos < length) {
+            // 查找同步头
+            const uint8_t* s = static_cast<const uint8_t*>(memchr(buf + pos, SYNC1, length - pos));
+            if (!s) return length;
+            pos = s - buf;
+            if (pos + 1 >= length) return pos;
+            if (buf[pos + 1] != SYNC2) {
+                pos++;
+                continue;
+            }
+            if (pos + HEADER_SIZE > length) return pos;
+
+            size_t bodyLen = buf[pos + 2] | (buf[pos + 3] << 8);
+            if (bodyLen < FRAME_MIN_SIZE || bodyLen > FRAME_MAX_SIZE) {
+                framingErrors++;
+                pos++;
+                continue;
+            }
+            if (pos + HEADER_SIZE + bodyLen > length) return pos;
+
+            if (Deliver(buf + pos + HEADER_SIZE, bodyLen)) {
+                pos += HEADER_SIZE + bodyLen;
+            } else {
+                // 校验失败说明同步头是假的，跳过一个字节继续找
+                pos++;
+            }
+        }
+        return length;
+    }
+};
+
+// 按分帧方式创建解码器，FRAME_TEXT 返回 nullptr
+inline FrameDecoder* CreateFrameDecoder(FrameMode mode) {
+    switch (mode) {
+        case FRAME_COBS:   return new CobsDecoder();
+        case FRAME_SLIP:   return new SlipDecoder();
+        case FRAME_LENGTH: return new LengthDecoder();
+        default:           return nullptr;
+    }
+}
+
+// 编码一帧并追加到 out
+inline void EncodeFrame(FrameMode mode, uint8_t type, uint8_t seq,
+                        const uint8_t* data, size_t length, std::vector<uint8_t>& out) {
+    // 先拼出帧体
+    std::vector<uint8_t> body;
+    body.reserve(length + FRAME_MIN_SIZE);
+    body.push_back(type);
+    body.push_back(seq);
+    if (length > 0) body.insert(body.end(), data, data + length);
+    uint16_t crc = crc16_ccitt(body.data(), body.size());
+    body.push_back(static_cast<uint8_t>(crc & 0xFF));
+    body.push_back(static_cast<uint8_t>(crc >> 8));
+
+    switch (mode) {
+        case FRAME_COBS: {
+            size_t codePos = out.size();
+            out.push_back(0);
+            uint8_t code = 1;
+            for (size_t i = 0; i < body.size(); i++) {
+                if (body[i] == 0) {
+                    out[codePos] = code;
+                    codePos = out.size();
+                    out.push_back(0);
+                    code = 1;
+                } else {
+                    out.push_back(body[i]);
+                    code++;
+                    if (code == 0xFF) {
+                        out[codePos] = code;
+                        codePos = out.size();
+                        out.push_back(0);
+                        code = 1;
+                    }
+                }
+            }
+            out[codePos] = code;
+            out.push_back(0);
+            break;
+        }
+        case FRAME_SLIP:
+            out.push_back(SlipDecoder::SLIP_END);
+            for (size_t i = 0; i < body.size(); i++) {
+                if (body[i] == SlipDecoder::SLIP_END) {
+                    out.push_back(SlipDecoder::SLIP_ESC);
+                    out.push_back(SlipDecoder::SLIP_ESC_END);
+                } else if (body[i] == SlipDecoder::SLIP_ESC) {
+                    out.push_back(SlipDecoder::SLIP_ESC);
+                    out.push_back(SlipDecoder::SLIP_ESC_ESC);
+                } else {
+                    out.push_back(body[i]);
+                }
+            }
+            out.push_back(SlipDecoder::SLIP_END);
+            break;
+        case FRAME_LENGTH:
+            out.push_back(LengthDecoder::SYNC1);
+            out.push_back(LengthDecoder::SYNC2);
+            out.push_back(static_cast<uint8_t>(body.size() & 0xFF));
+            out.push_back(static_cast<uint8_t>(body.size() >> 8));
+            out.insert(out.end(), body.begin(), body.end());
+            break;
+        default:
+            out.insert(out.end(), data, data + length);
+            break;
+    }
+}
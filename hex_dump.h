@@ -0,0 +1,252 @@
+// hex_dump.h
+// 原始收发字节的十六进制 + ASCII 转储
+//
+// HexDumpStore 只保存原始字节（按收发方向分段），不保存格式化后的文本；
+// 界面只格式化当前可见的几十行，数据再多、来得再快也不会拖慢界面。
+// 字节转十六进制在 SSE2 / NEON 上一次处理 16 字节，其他平台逐字节查表。
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "capture_file.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HEX_DUMP_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define HEX_DUMP_NEON 1
+#endif
+
+static const size_t HEX_ROW_BYTES = 16;
+// 一行："RX 00001230  41 42 43 44 45 46 47 48  49 4A 4B 4C 4D 4E 4F 50  |ABCDEFGHIJKLMNOP|"
+static const size_t HEX_ROW_CHARS = 3 + 8 + 2 + HEX_ROW_BYTES * 3 + 1 + 1 + HEX_ROW_BYTES + 1;
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// 16 字节转 32 个大写十六进制字符
+inline void HexEncode16(const uint8_t* in, char* out) {
+#if defined(HEX_DUMP_SSE2)
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i lo = _mm_and_si128(v, nibble);
+    // 0-9 加 '0'，10-15 再多加 7 落到 'A'-'F'
+    __m128i nine = _mm_set1_epi8(9);
+    __m128i zero = _mm_set1_epi8('0');
+    __m128i letter = _mm_set1_epi8('A' - '0' - 10);
+    hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter));
+    lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(hi, lo));
+#elif defined(HEX_DUMP_NEON)
+    uint8x16_t v = vld1q_u8(in);
+    uint8x16_t table = vld1q_u8(reinterpret_cast<const uint8_t*>(HEX_DIGITS));
+    uint8x16_t hi = vqtbl1q_u8(table, vshrq_n_u8(v, 4));
+    uint8x16_t lo = vqtbl1q_u8(table, vandq_u8(v, vdupq_n_u8(0x0F)));
+    uint8x16x2_t pairs = vzipq_u8(hi, lo);
+    vst1q_u8(reinterpret_cast<uint8_t*>(out), pairs.val[0]);
+    vst1q_u8(reinterpret_cast<uint8_t*>(out + 16), pairs.val[1]);
+#else
+    for (size_t i = 0; i < 16; i++) {
+        out[i * 2] = HEX_DIGITS[in[i] >> 4];
+        out[i * 2 + 1] = HEX_DIGITS[in[i] & 0x0F];
+    }
+#endif
+}
+
+// 16 字节转 ASCII，不可打印的字节显示为 '.'
+inline void PrintableAscii16(const uint8_t* in, char* out) {
+#if defined(HEX_DUMP_SSE2)
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    // 按有符号比较，0x80 以上是负数，自然落在范围外
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+    __m128i result = _mm_or_si128(_mm_and_si128(printable, v), _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+#elif defined(HEX_DUMP_NEON)
+    uint8x16_t v = vld1q_u8(in);
+    uint8x16_t printable = vandq_u8(vcgeq_u8(v, vdupq_n_u8(0x20)), vcleq_u8(v, vdupq_n_u8(0x7E)));
+    vst1q_u8(reinterpret_cast<uint8_t*>(out), vbslq_u8(printable, v, vdupq_n_u8('.')));
+#else
+    for (size_t i = 0; i < 16; i++) {
+        out[i] = (in[i] >= 0x20 && in[i] < 0x7F) ? static_cast<char>(in[i]) : '.';
+    }
+#endif
+}
+
+// 格式化一行（不足 16 字节的行右侧补空格），写入 HEX_ROW_CHARS 个字符，不加结尾 0
+inline void FormatHexRow(const uint8_t* data, size_t length, uint64_t offset, int direction, char* out) {
+    uint8_t row[HEX_ROW_BYTES];
+    if (length < HEX_ROW_BYTES) {
+        memset(row, 0, sizeof(row));
+        memcpy(row, data, length);
+        data = row;
+    }
+    char hex[HEX_ROW_BYTES * 2];
+    char ascii[HEX_ROW_BYTES];
+    HexEncode16(data, hex);
+    PrintableAscii16(data, ascii);
+
+    char* p = out;
+    memcpy(p, direction == CAPTURE_TX ? "TX " : "RX ", 3);
+    p += 3;
+    for (int shift = 28; shift >= 0; shift -= 4) *p++ = HEX_DIGITS[(offset >> shift) & 0x0F];
+    *p++ = ' ';
+    *p++ = ' ';
+    for (size_t i = 0; i < HEX_ROW_BYTES; i++) {
+        if (i < length) {
+            p[0] = hex[i * 2];
+            p[1] = hex[i * 2 + 1];
+        } else {
+            p[0] = ' ';
+            p[1] = ' ';
+        }
+        p[2] = ' ';
+        p += 3;
+        if (i == 7) *p++ = ' ';
+    }
+    *p++ = '|';
+    memcpy(p, ascii, length);
+    memset(p + length, ' ', HEX_ROW_BYTES - length);
+    p += HEX_ROW_BYTES;
+    *p++ = '|';
+}
+
+// 收发字节的环形存储，超过容量时按整行丢弃最早的数据
+// 同方向连续的数据接在一起按 16 字节分行，方向改变时另起一行
+class HexDumpStore {
+public:
+    HexDumpStore(size_t capacity = 16 * 1024 * 1024)
+        : capacity(capacity), base(0), total(0), nextRow(0), version(0) {
+        bytes.reserve(capacity);
+    }
+
+    // 接收线程和发送线程调用；字节缓冲区预先分配，追加时不会重新分配和搬移，
+    // 只有收发方向切换、新开一段时 segments 可能分配一小块
+    void Append(int direction, const uint8_t* data, size_t length) {
+        if (length == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (length > capacity) {
+            // 一次超过容量，只留最后一段；先清空，行号接着已有的往后排
+            ClearLocked();
+            data += length - capacity;
+            total += length - capacity;
+            base = total;
+            length = capacity;
+        }
+        if (bytes.size() + length > capacity) Trim(bytes.size() + length - capacity);
+
+        if (segments.empty() || segments.back().direction != direction) {
+            Segment s;
+            s.start = total;
+            s.firstRow = segments.empty() ? nextRow : EndRow();
+            s.direction = direction;
+            segments.push_back(s);
+        }
+        bytes.insert(bytes.end(), data, data + length);
+        total += length;
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ClearLocked();
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    // 每次追加都会改变，界面据此判断是否需要重画
+    uint32_t GetVersion() const { return version.load(std::memory_order_acquire); }
+
+    // 当前保存的行号范围 [first, end)，行号从开始记录起单调递增
+    void GetRows(uint64_t& first, uint64_t& end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        first = segments.empty() ? 0 : segments.front().firstRow;
+        end = segments.empty() ? 0 : EndRow();
+    }
+
+    // 从 firstRow 起格式化最多 count 行到 out（每行 HEX_ROW_CHARS 个字符），
+    // 各行方向写入 directions，返回实际行数
+    size_t FormatRows(uint64_t firstRow, size_t count, char* out, int* directions) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (segments.empty()) return 0;
+        firstRow = std::max(firstRow, segments.front().firstRow);
+
+        // 找到 firstRow 所在的段
+        size_t s = 0, hi = segments.size();
+        while (hi - s > 1) {
+            size_t mid = (s + hi) / 2;
+            if (segments[mid].firstRow <= firstRow) s = mid;
+            else hi = mid;
+        }
+
+        size_t rows = 0;
+        uint64_t row = firstRow;
+        for (; s < segments.size() && rows < count; s++) {
+            uint64_t end = s + 1 < segments.size() ? segments[s + 1].start : total;
+            for (uint64_t offset = segments[s].start + (row - segments[s].firstRow) * HEX_ROW_BYTES;
+                 offset < end && rows < count; offset += HEX_ROW_BYTES, row++, rows++) {
+                size_t length = static_cast<size_t>(std::min<uint64_t>(HEX_ROW_BYTES, end - offset));
+                FormatHexRow(&bytes[offset - base], length, offset, segments[s].direction, out + rows * HEX_ROW_CHARS);
+                directions[rows] = segments[s].direction;
+            }
+            if (s + 1 < segments.size()) row = segments[s + 1].firstRow;
+        }
+        return rows;
+    }
+
+private:
+    struct Segment {
+        uint64_t start;     // 第一个字节的流偏移
+        uint64_t firstRow;
+        int direction;
+    };
+
+    uint64_t EndRow() const {
+        const Segment& last = segments.back();
+        return last.firstRow + (total - last.start + HEX_ROW_BYTES - 1) / HEX_ROW_BYTES;
+    }
+
+    // 清空后行号不回到 0，界面保存的行号仍然有效
+    void ClearLocked() {
+        if (!segments.empty()) nextRow = EndRow();
+        bytes.clear();
+        segments.clear();
+        base = total;
+    }
+
+    // 从最早的数据起按整行丢弃至少 need 字节；一次多丢一些，减少搬移次数
+    void Trim(size_t need) {
+        uint64_t target = base + std::max(need, capacity / 4);
+        while (!segments.empty()) {
+            Segment& front = segments.front();
+            uint64_t end = segments.size() > 1 ? segments[1].start : total;
+            if (end <= target && segments.size() > 1) {
+                segments.pop_front();
+                continue;
+            }
+            uint64_t rows = (std::min(target, end) - front.start + HEX_ROW_BYTES - 1) / HEX_ROW_BYTES;
+            front.start = std::min(end, front.start + rows * HEX_ROW_BYTES);
+            front.firstRow += rows;
+            break;
+        }
+        uint64_t newBase = segments.empty() ? total : segments.front().start;
+        bytes.erase(bytes.begin(), bytes.begin() + static_cast<size_t>(newBase - base));
+        base = newBase;
+    }
+
+    std::mutex mutex;
+    std::vector<uint8_t> bytes;     // bytes[0] 对应流偏移 base
+    std::deque<Segment> segments;
+    size_t capacity;
+    uint64_t base;
+    uint64_t total;                 // 累计收发字节数
+    uint64_t nextRow;               // 清空后新的第一段从这一行开始
+    std::atomic<uint32_t> version;
+};
@@ -0,0 +1,473 @@
+// image_compare.h
+// 回读镜像与参考镜像（合并工具生成的 merged.bin）逐字节比较
+//
+// 两个文件都用内存映射打开，按 64 字节一块比较：相同的块只做异或和判零，
+// 不同的块才算出逐字节的差异掩码，按连续的位段记录差异。
+// 相隔不超过 mergeGap 的差异合并成一个区域，区域不跨越布局里的段（bootloader / gap / app），
+// 报告里带上所在段的名字。回读比参考长的部分按擦除值 0xFF 比较，短的部分整段记为缺失。
+// 块比较在 AVX2 / SSE2 / NEON 上用向量指令，其他平台按 8 字节整数比较。
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IMAGE_COMPARE_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_COMPARE_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define IMAGE_COMPARE_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 只读内存映射文件，空文件不映射，Data() 返回 nullptr
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), size(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#endif
+    }
+
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& path, std::string& error) {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "Failed to open " + path + ", error " + std::to_string(GetLastError());
+            return false;
+        }
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length)) {
+            error = "Failed to get size of " + path;
+            Close();
+            return false;
+        }
+        size = static_cast<uint64_t>(length.QuadPart);
+        if (size == 0) return true;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) {
+            error = "Failed to map " + path + ", error " + std::to_string(GetLastError());
+            Close();
+            return false;
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "Failed to open " + path + ": " + strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            error = "Failed to get size of " + path + ": " + strerror(errno);
+            close(fd);
+            return false;
+        }
+        size = static_cast<uint64_t>(st.st_size);
+        if (size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                error = "Failed to map " + path + ": " + strerror(errno);
+                close(fd);
+                size = 0;
+                return false;
+            }
+            // 顺序读，让内核提前预读
+            madvise(p, size, MADV_SEQUENTIAL);
+            data = static_cast<const uint8_t*>(p);
+        }
+        close(fd);
+#endif
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* Data() const { return data; }
+    uint64_t Size() const { return size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const uint8_t* data;
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// 镜像布局：按地址排列的命名段，段外的地址归到 outsideName
+class ImageLayout {
+public:
+    ImageLayout() : outsideName("image") {}
+
+    // 合并工具的布局：bootloader 在 0，app 在 appOffset，中间用 0xFF 填充
+    static ImageLayout FromMerge(uint64_t bootSize, uint64_t appOffset, uint64_t appSize) {
+        ImageLayout layout;
+        layout.Add("bootloader", 0, bootSize);
+        if (appOffset > bootSize) layout.Add("gap", bootSize, appOffset);
+        layout.Add("app", appOffset, appOffset + appSize);
+        layout.outsideName = "beyond image";
+        return layout;
+    }
+
+    void Add(const std::string& name, uint64_t start, uint64_t end) {
+        if (end <= start) return;
+        Segment s = { name, start, end };
+        segments.push_back(s);
+    }
+
+    // 地址所在段的序号，段外返回 -1；end 为该段（或段外这一段）的结束地址
+    int Find(uint64_t address, uint64_t& end) const {
+        end = UINT64_MAX;
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (address >= segments[i].start && address < segments[i].end) {
+                end = segments[i].end;
+                return static_cast<int>(i);
+            }
+            if (segments[i].start > address && segments[i].start < end) end = segments[i].start;
+        }
+        return -1;
+    }
+
+    const std::string& Name(int index) const { return index < 0 ? outsideName : segments[index].name; }
+
+private:
+    struct Segment {
+        std::string name;
+        uint64_t start;
+        uint64_t end;
+    };
+    std::vector<Segment> segments;
+    std::string outsideName;
+};
+
+// 一段差异：[start, end) 内有 bytesDiffer 个字节不同
+struct DiffRegion {
+    uint64_t start;
+    uint64_t end;
+    uint64_t bytesDiffer;
+    bool missing;           // 回读比参考短，这一段没有数据
+    std::string segment;
+};
+
+struct CompareResult {
+    uint64_t referenceSize;
+    uint64_t imageSize;
+    uint64_t bytesDiffer;       // 包括缺失的字节
+    uint64_t regionCount;       // 全部区域数，regions 里最多保存 maxRegions 个
+    std::vector<DiffRegion> regions;
+    double seconds;
+
+    bool Identical() const { return bytesDiffer == 0; }
+};
+
+inline unsigned ImageCompareCtz64(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+}
+
+// 64 字节是否完全相同
+inline bool ImageBlockEqual(const uint8_t* a, const uint8_t* b) {
+#if defined(IMAGE_COMPARE_AVX2)
+    __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 32)),
+                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32)));
+    __m256i x = _mm256_or_si256(x0, x1);
+    return _mm256_testz_si256(x, x) != 0;
+#elif defined(IMAGE_COMPARE_SSE2)
+    __m128i x = _mm_setzero_si128();
+    for (int i = 0; i < 64; i += 16) {
+        x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(IMAGE_COMPARE_NEON)
+    uint8x16_t x = veorq_u8(vld1q_u8(a), vld1q_u8(b));
+    x = vorrq_u8(x, veorq_u8(vld1q_u8(a + 16), vld1q_u8(b + 16)));
+    x = vorrq_u8(x, veorq_u8(vld1q_u8(a + 32), vld1q_u8(b + 32)));
+    x = vorrq_u8(x, veorq_u8(vld1q_u8(a + 48), vld1q_u8(b + 48)));
+    return vmaxvq_u8(x) == 0;
+#else
+    uint64_t x = 0;
+    for (int i = 0; i < 64; i += 8) {
+        uint64_t va, vb;
+        memcpy(&va, a + i, 8);
+        memcpy(&vb, b + i, 8);
+        x |= va ^ vb;
+    }
+    return x == 0;
+#endif
+}
+
+// 64 字节的差异掩码，第 i 位为 1 表示第 i 个字节不同
+inline uint64_t ImageBlockDiffMask(const uint8_t* a, const uint8_t* b) {
+#if defined(IMAGE_COMPARE_AVX2)
+    uint32_t lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)))));
+    uint32_t hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32)))));
+    return ~(static_cast<uint64_t>(hi) << 32 | lo);
+#elif defined(IMAGE_COMPARE_SSE2)
+    uint64_t equal = 0;
+    for (int i = 0; i < 64; i += 16) {
+        uint32_t m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)))));
+        equal |= static_cast<uint64_t>(m) << i;
+    }
+    return ~equal;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++) {
+        if (a[i] != b[i]) mask |= 1ULL << i;
+    }
+    return mask;
+#endif
+}
+
+class ImageComparer {
+public:
+    // 相隔不超过 mergeGap 字节的差异并成一个区域；最多保存 maxRegions 个区域，其余只计数
+    explicit ImageComparer(const ImageLayout& layout, uint64_t mergeGap = 16, size_t maxRegions = 1000)
+        : layout(layout), mergeGap(mergeGap), maxRegions(maxRegions) {}
+
+    void Compare(const uint8_t* reference, uint64_t referenceSize,
+                 const uint8_t* image, uint64_t imageSize, CompareResult& result) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        out = &result;
+        result.referenceSize = referenceSize;
+        result.imageSize = imageSize;
+        result.bytesDiffer = 0;
+        result.regionCount = 0;
+        result.regions.clear();
+        open = false;
+
+        uint64_t common = referenceSize < imageSize ? referenceSize : imageSize;
+        Scan(image, reference, 64, 0, common);
+        if (imageSize > referenceSize) {
+            // 参考镜像之后的部分应该是擦除状态
+            static const uint8_t erased[64] = {
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+            };
+            Scan(image + common, erased, 0, common, imageSize - common);
+        }
+        Flush();
+        if (referenceSize > imageSize) {
+            // 缺失的部分按段拆开，每段一个区域
+            for (uint64_t address = imageSize; address < referenceSize;) {
+                uint64_t end;
+                int segment = layout.Find(address, end);
+                if (end > referenceSize) end = referenceSize;
+                DiffRegion region = { address, end, end - address, true, layout.Name(segment) };
+                Emit(region);
+                address = end;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 报告里的一行："0x00002000-0x000020FF  256 bytes, 200 differ  [app]"
+    static std::string FormatRegion(const DiffRegion& r) {
+        char line[160];
+        snprintf(line, sizeof(line), "0x%08llX-0x%08llX  %llu bytes, %s%llu differ  [%s]",
+                 (unsigned long long)r.start, (unsigned long long)(r.end - 1),
+                 (unsigned long long)(r.end - r.start), r.missing ? "missing, " : "",
+                 (unsigned long long)r.bytesDiffer, r.segment.c_str());
+        return line;
+    }
+
+private:
+    // 比较 n 个字节，b 每块前进 bStep（为 0 时每块都和同一块比较），地址从 base 开始
+    void Scan(const uint8_t* a, const uint8_t* b, size_t bStep, uint64_t base, uint64_t n) {
+        uint64_t offset = 0;
+        for (; offset + 64 <= n; offset += 64, b += bStep) {
+            if (ImageBlockEqual(a + offset, b)) continue;
+            AddMask(base + offset, ImageBlockDiffMask(a + offset, b));
+        }
+        // 不足一块的尾部
+        uint64_t mask = 0;
+        for (uint64_t i = 0; offset + i < n; i++) {
+            if (a[offset + i] != b[i]) mask |= 1ULL << i;
+        }
+        if (mask) AddMask(base + offset, mask);
+    }
+
+    // 把掩码里每一段连续的 1 作为一次差异
+    void AddMask(uint64_t address, uint64_t mask) {
+        while (mask) {
+            unsigned first = ImageCompareCtz64(mask);
+            uint64_t rest = ~(mask >> first);
+            unsigned length = rest ? ImageCompareCtz64(rest) : 64 - first;
+            AddRun(address + first, length);
+            if (first + length >= 64) break;
+            mask &= ~0ULL << (first + length);
+        }
+    }
+
+    void AddRun(uint64_t address, uint64_t length) {
+        while (length > 0) {
+            // 当前区域所在段之外的部分另起一个区域
+            if (open && address >= current.end && address - current.end <= mergeGap && address < segmentEnd) {
+                uint64_t n = length < segmentEnd - address ? length : segmentEnd - address;
+                current.end = address + n;
+                current.bytesDiffer += n;
+                address += n;
+                length -= n;
+                continue;
+            }
+            Flush();
+            int segment = layout.Find(address, segmentEnd);
+            uint64_t n = length < segmentEnd - address ? length : segmentEnd - address;
+            current.start = address;
+            current.end = address + n;
+            current.bytesDiffer = n;
+            current.missing = false;
+            current.segment = layout.Name(segment);
+            open = true;
+            address += n;
+            length -= n;
+        }
+    }
+
+    void Flush() {
+        if (!open) return;
+        open = false;
+        Emit(current);
+    }
+
+    void Emit(const DiffRegion& region) {
+        out->bytesDiffer += region.bytesDiffer;
+        out->regionCount++;
+        if (out->regions.size() < maxRegions) out->regions.push_back(region);
+    }
+
+    ImageLayout layout;
+    uint64_t mergeGap;
+    size_t maxRegions;
+
+    CompareResult* out;
+    bool open;
+    DiffRegion current;
+    uint64_t segmentEnd;
+};
+
+// 一个回读文件的比较报告，第一行为 PASS / FAIL，不一致时每个区域一行，行间用 '\n' 分隔
+inline std::string FormatCompareReport(const std::string& name, const CompareResult& r) {
+    if (r.Identical()) return "PASS  " + name;
+    char line[160];
+    snprintf(line, sizeof(line), ": %llu bytes differ in %llu regions",
+             (unsigned long long)r.bytesDiffer, (unsigned long long)r.regionCount);
+    std::string report = "FAIL  " + name + line;
+    if (r.imageSize != r.referenceSize) {
+        snprintf(line, sizeof(line), ", size %llu, expected %llu",
+                 (unsigned long long)r.imageSize, (unsigned long long)r.referenceSize);
+        report += line;
+    }
+    for (size_t k = 0; k < r.regions.size(); k++) {
+        report += "\n      " + ImageComparer::FormatRegion(r.regions[k]);
+    }
+    if (r.regionCount > r.regions.size()) {
+        snprintf(line, sizeof(line), "\n      ... %llu more regions", (unsigned long long)(r.regionCount - r.regions.size()));
+        report += line;
+    }
+    return report;
+}
+
+// 批量比较：参考镜像只映射一次，多个线程各自取下一个回读文件比较
+// done 在工作线程中调用，index 为文件在 paths 里的序号；打不开的文件 error 非空
+class ImageBatch {
+public:
+    typedef std::function<void(size_t index, const CompareResult& result, const std::string& error)> DoneHandler;
+
+    ImageBatch(const MappedFile& reference, const ImageLayout& layout)
+        : reference(reference), layout(layout), mergeGap(16), maxRegions(1000) {}
+
+    void SetMergeGap(uint64_t bytes) { mergeGap = bytes; }
+    void SetMaxRegions(size_t count) { maxRegions = count; }
+
+    void Run(const std::vector<std::string>& paths, size_t threadCount, const DoneHandler& done) {
+        std::atomic<size_t> next(0);
+        if (threadCount < 1) threadCount = 1;
+        if (threadCount > paths.size()) threadCount = paths.size();
+        std::vector<std::thread*> workers;
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.push_back(new std::thread([&]() {
+                ImageComparer comparer(layout, mergeGap, maxRegions);
+                CompareResult result;
+                for (size_t index = next++; index < paths.size(); index = next++) {
+                    MappedFile image;
+                    std::string error;
+                    if (!image.Open(paths[index], error)) {
+                        result = CompareResult();
+                        done(index, result, error);
+                        continue;
+                    }
+                    comparer.Compare(reference.Data(), reference.Size(), image.Data(), image.Size(), result);
+                    done(index, result, error);
+                }
+            }));
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->join();
+            delete workers[i];
+        }
+    }
+
+private:
+    const MappedFile& reference;
+    ImageLayout layout;
+    uint64_t mergeGap;
+    size_t maxRegions;
+};
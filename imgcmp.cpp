@@ -0,0 +1,138 @@
+// imgcmp.cpp
+// 回读镜像批量比较：产线末端把一批设备的 flash 回读文件和合并工具生成的 merged.bin 比较，
+// 每个文件输出 PASS / FAIL，不一致的列出差异区域和所在的段。不依赖 wxWidgets。
+//
+// 用法：imgcmp [-j 线程数] [--gap 字节数] [--regions 条数] [--list 文件]
+//             [--boot bootloader.bin --app app.bin --app-addr 地址 | --layout boot大小,app地址,app大小]
+//             merged.bin 回读文件...
+//
+// --boot / --app / --app-addr 与合并工具的输入相同，用来标注差异所在的段；
+// --list 从文件中读取回读文件路径，每行一个。有任何文件不一致或打不开时返回 1。
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include "image_compare.h"
+
+static bool ParseNumber(const std::string& text, uint64_t& value) {
+    char* end = nullptr;
+    value = strtoull(text.c_str(), &end, 0);
+    return !text.empty() && *end == 0;
+}
+
+static bool FileSize(const std::string& path, uint64_t& size) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    size = static_cast<uint64_t>(file.tellg());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t threads = std::thread::hardware_concurrency();
+    uint64_t gap = 16;
+    uint64_t maxRegions = 20;
+    std::string bootPath, appPath, layoutText;
+    uint64_t appAddr = 0x2000;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string opt = argv[i];
+        if (opt.size() < 2 || opt[0] != '-') {
+            paths.push_back(opt);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", opt.c_str());
+            return 2;
+        }
+        std::string value = argv[++i];
+        uint64_t number = 0;
+        bool numeric = ParseNumber(value, number);
+        if (opt == "-j" && numeric) threads = static_cast<size_t>(number);
+        else if (opt == "--gap" && numeric) gap = number;
+        else if (opt == "--regions" && numeric) maxRegions = number;
+        else if (opt == "--app-addr" && numeric) appAddr = number;
+        else if (opt == "--boot") bootPath = value;
+        else if (opt == "--app") appPath = value;
+        else if (opt == "--layout") layoutText = value;
+        else if (opt == "--list") {
+            std::ifstream list(value);
+            if (!list) {
+                fprintf(stderr, "Failed to open %s\n", value.c_str());
+                return 2;
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+                if (!line.empty()) paths.push_back(line);
+            }
+        } else {
+            fprintf(stderr, "Invalid option: %s %s\n", opt.c_str(), value.c_str());
+            return 2;
+        }
+    }
+    if (paths.size() < 2) {
+        fprintf(stderr, "Usage: imgcmp [options] merged.bin readback...\n");
+        return 2;
+    }
+    std::string referencePath = paths[0];
+    paths.erase(paths.begin());
+
+    ImageLayout layout;
+    if (!layoutText.empty()) {
+        uint64_t values[3];
+        size_t start = 0;
+        for (int k = 0; k < 3; k++) {
+            size_t comma = layoutText.find(',', start);
+            std::string part = layoutText.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+            if (!ParseNumber(part, values[k]) || (k < 2 && comma == std::string::npos)) {
+                fprintf(stderr, "Invalid layout: %s\n", layoutText.c_str());
+                return 2;
+            }
+            start = comma + 1;
+        }
+        layout = ImageLayout::FromMerge(values[0], values[1], values[2]);
+    } else if (!bootPath.empty() || !appPath.empty()) {
+        uint64_t bootSize = 0, appSize = 0;
+        if (!FileSize(bootPath, bootSize) || !FileSize(appPath, appSize)) {
+            fprintf(stderr, "--boot and --app must both name readable files\n");
+            return 2;
+        }
+        layout = ImageLayout::FromMerge(bootSize, appAddr, appSize);
+    }
+
+    MappedFile reference;
+    std::string error;
+    if (!reference.Open(referencePath, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+
+    // 结果按完成顺序打印，同一文件的几行不会和其他文件交错
+    std::mutex printMutex;
+    size_t failed = 0;
+    uint64_t totalBytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ImageBatch batch(reference, layout);
+    batch.SetMaxRegions(static_cast<size_t>(maxRegions));
+    batch.SetMergeGap(gap);
+    batch.Run(paths, threads, [&](size_t index, const CompareResult& r, const std::string& error) {
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (!error.empty()) {
+            failed++;
+            printf("ERROR %s: %s\n", paths[index].c_str(), error.c_str());
+            return;
+        }
+        totalBytes += r.imageSize;
+        if (!r.Identical()) failed++;
+        printf("%s\n", FormatCompareReport(paths[index], r).c_str());
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu files, %zu failed, %.1f MB compared in %.3f s (%.0f MB/s)\n",
+           paths.size(), failed, totalBytes / 1e6, seconds, seconds > 0 ? totalBytes / 1e6 / seconds : 0.0);
+    return failed ? 1 : 0;
+}
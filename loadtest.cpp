@@ -0,0 +1,470 @@
+// loadtest.cpp
+// 串口收发链路压力测试：在本进程里启动虚拟电池设备，用 BatteryLink 按串口工具
+// 相同的方式收发，统计吞吐和各阶段延迟。不需要硬件，可以在 CI 中运行。
+//
+// 用法：loadtest [-m cobs|slip|length] [-t 秒] [-r 频率|max] [-b 波特率]
+//               [-w 命令窗口] [--raw] [--tx-rate 条/秒] [--ota 字节数]
+//               [--fast] [--max-baud 波特率] [--reliable-baud 波特率]
+//               [--corrupt 概率] [--garbage 概率] [--delay 毫秒]
+//               [--json 文件] [--min-rx 字节/秒] [--max-rtt-us 微秒]
+//
+// 二进制模式：遥测进快照，界面线程按 100ms 节拍读取；同时保持 -w 条命令在途，
+//   统计命令往返时间。
+// --raw：按文本模式打开，设备发来的数据全部走原始数据事件；同时按 --tx-rate
+//   通过发送队列发文本，统计入队到写完的时间。
+// 结束后可选做一次 OTA 下载；--fast 时下载前先协商更高的线路速率，下载后切回原速率，
+// --max-baud / --reliable-baud 设定设备支持和线路能稳定工作的最高速率，用来测试回退。
+// 达不到 --min-rx 或 --max-rtt-us、命令出错、OTA 失败、没能回到原速率时返回非 0。
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include "battery_simulator.h"
+#include "battery_link.h"
+#include "ota_transfer.h"
+#include "baud_negotiator.h"
+#include "pipeline_metrics.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// --fast 时下载失败最多尝试的次数（含第一次），每次降一档速率
+static const int MAX_OTA_ATTEMPTS = 3;
+
+struct LoadTestOptions {
+    FrameMode mode;
+    double seconds;
+    double rate;
+    int baud;
+    int window;
+    bool raw;
+    double txRate;
+    size_t otaSize;
+    bool fast;
+    int maxBaud;
+    SimulatorFaults faults;
+    std::string jsonPath;
+    double minRx;
+    double maxRttUs;
+};
+
+// 代替界面线程：接收线程投递的事件在这里排队，由主线程取出“显示”
+class EventQueue {
+public:
+    void Post(int64_t queued, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(std::make_pair(queued, bytes));
+    }
+
+    // 取出全部事件，记录投递到处理的延迟，返回处理的字节数
+    size_t Drain(LatencyHistogram& eventToUi) {
+        std::deque<std::pair<int64_t, size_t> > batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(events);
+        }
+        size_t bytes = 0;
+        int64_t now = MetricsNow();
+        for (size_t i = 0; i < batch.size(); i++) {
+            eventToUi.Record(now - batch[i].first);
+            bytes += batch[i].second;
+        }
+        return bytes;
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<std::pair<int64_t, size_t> > events;
+};
+
+// 与串口工具的发送线程相同：队列 + 条件变量，写完记录入队到写完的时间
+class SendQueue {
+public:
+    SendQueue(BatteryLink& link, PipelineMetrics& metrics)
+        : link(link), metrics(metrics), running(true), thread(nullptr) {
+        thread = new std::thread(&SendQueue::SendThread, this);
+    }
+
+    ~SendQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_one();
+        thread->join();
+        delete thread;
+    }
+
+    void Push(const std::string& data) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push(std::make_pair(data, MetricsNow()));
+            metrics.sendQueueDepth++;
+        }
+        condition.notify_one();
+    }
+
+private:
+    void SendThread() {
+        while (true) {
+            std::pair<std::string, int64_t> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return !items.empty() || !running; });
+                if (!running) break;
+                item = items.front();
+                items.pop();
+                metrics.sendQueueDepth--;
+            }
+            if (link.Write(reinterpret_cast<const uint8_t*>(item.first.data()), item.first.size())) {
+                metrics.enqueueToWrite.Record(MetricsNow() - item.second);
+            }
+        }
+    }
+
+    BatteryLink& link;
+    PipelineMetrics& metrics;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::queue<std::pair<std::string, int64_t> > items;
+    bool running;
+    std::thread* thread;
+};
+
+// 命令负载：始终保持 window 条 CMD_CLEAN 在途，完成一条补一条
+class CommandLoad {
+public:
+    CommandLoad(CommandEngine* engine) : stopped(false), completed(0), failed(0), engine(engine) {}
+
+    void Start(int window) {
+        for (int i = 0; i < window; i++) Submit();
+    }
+
+    void Stop() { stopped = true; }
+
+    LatencyHistogram roundTrip;
+    std::atomic<bool> stopped;
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> failed;
+
+private:
+    void Submit() {
+        int64_t sent = MetricsNow();
+        engine->Submit(CMD_CLEAN, std::vector<uint8_t>(), [this, sent](const CommandResult& r) {
+            if (r.status == CMD_STATUS_CANCELLED) return;
+            if (r.status == CMD_STATUS_OK) {
+                roundTrip.Record(MetricsNow() - sent);
+                completed++;
+            } else {
+                failed++;
+            }
+            if (!stopped) Submit();
+        }, 500, 3);
+    }
+
+    CommandEngine* engine;
+};
+
+// 随机内容加合并工具格式的尾部，设备端可以校验
+static std::vector<uint8_t> MakeOtaImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < size; i++) image[i] = static_cast<uint8_t>(rng());
+    uint32_t crc = crc32(image.data(), size, 0xFFFFFFFF);
+    PutLe32(image, OTA_MAGIC1);
+    PutLe32(image, OTA_MAGIC2);
+    PutLe32(image, static_cast<uint32_t>(size));
+    PutLe32(image, crc);
+    PutLe32(image, OTA_MAGIC2);
+    PutLe32(image, OTA_MAGIC1);
+    return image;
+}
+
+// 分位数和最大值；没有样本时（如二进制模式下没有界面事件）为 n/a，不显示成 0
+static std::string FormatLatency(const HistogramSnapshot& h) {
+    if (h.count == 0) return "n/a (no samples)";
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "p50 %.0f us, p99 %.0f us, max %.0f us",
+             h.Percentile(0.5), h.Percentile(0.99), h.maxNs / 1000.0);
+    return buffer;
+}
+
+static void PrintLatency(const char* stage, const HistogramSnapshot& h) {
+    printf("%-13s %s\n", stage, FormatLatency(h).c_str());
+}
+
+// 协商或恢复线路速率，等到结束
+static bool ChangeSpeed(BaudNegotiator& speed, bool raise, std::string& message) {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+    bool ok = false;
+    BaudNegotiator::DoneHandler handler = [&](bool success, int, const std::string& msg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        ok = success;
+        message = msg;
+        condition.notify_one();
+    };
+    if (raise) speed.Raise(handler);
+    else speed.Restore(handler);
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&] { return done; });
+    return ok;
+}
+
+// 下载一次，返回是否成功，bytesPerSecond 为有效吞吐
+static bool RunOta(BatteryLink& link, size_t size, double& bytesPerSecond, std::string& message) {
+    std::vector<uint8_t> image = MakeOtaImage(size);
+    OtaTransfer ota(link.GetEngine(), image);
+    ota.SetBaudRate(link.GetBaudRate());
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+    bool ok = false;
+    ota.SetDoneHandler([&](bool success, const std::string& msg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        ok = success;
+        message = msg;
+        condition.notify_one();
+    });
+    Clock::time_point start = Clock::now();
+    ota.Start();
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!condition.wait_for(lock, std::chrono::seconds(120), [&] { return done; })) {
+        // 中止后还要等结束回调，之后才没有命令回调引用 ota
+        lock.unlock();
+        ota.Abort();
+        lock.lock();
+        condition.wait(lock, [&] { return done; });
+        message = "OTA timed out";
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    bytesPerSecond = seconds > 0 ? image.size() / seconds : 0;
+    return ok;
+}
+
+static bool ParseOptions(int argc, char** argv, LoadTestOptions& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (name == "--raw") {
+            opt.raw = true;
+            continue;
+        }
+        if (name == "--fast") {
+            opt.fast = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", name.c_str());
+            return false;
+        }
+        std::string value = argv[++i];
+        if (name == "-m") {
+            if (!ParseFrameMode(value, opt.mode)) {
+                fprintf(stderr, "Unknown framing: %s\n", value.c_str());
+                return false;
+            }
+        } else if (name == "-t") opt.seconds = atof(value.c_str());
+        else if (name == "-r") opt.rate = value == "max" ? -1 : atof(value.c_str());
+        else if (name == "-b") opt.baud = atoi(value.c_str());
+        else if (name == "-w") opt.window = atoi(value.c_str());
+        else if (name == "--tx-rate") opt.txRate = atof(value.c_str());
+        else if (name == "--ota") opt.otaSize = strtoul(value.c_str(), nullptr, 0);
+        else if (name == "--corrupt") opt.faults.corruptRate = atof(value.c_str());
+        else if (name == "--garbage") opt.faults.garbageRate = atof(value.c_str());
+        else if (name == "--delay") opt.faults.responseDelayMs = atoi(value.c_str());
+        else if (name == "--max-baud") opt.maxBaud = atoi(value.c_str());
+        else if (name == "--reliable-baud") opt.faults.maxReliableBaud = atoi(value.c_str());
+        else if (name == "--json") opt.jsonPath = value;
+        else if (name == "--min-rx") opt.minRx = atof(value.c_str());
+        else if (name == "--max-rtt-us") opt.maxRttUs = atof(value.c_str());
+        else {
+            fprintf(stderr, "Unknown option: %s\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    LoadTestOptions opt;
+    opt.mode = FRAME_COBS;
+    opt.seconds = 5;
+    opt.rate = -1;
+    opt.baud = 921600;
+    opt.window = 4;
+    opt.raw = false;
+    opt.txRate = 1000;
+    opt.otaSize = 0;
+    opt.fast = false;
+    opt.maxBaud = 3000000;
+    opt.faults = SimulatorFaults();
+    opt.minRx = 0;
+    opt.maxRttUs = 0;
+    if (!ParseOptions(argc, argv, opt)) return 2;
+
+    BatterySimulator sim(opt.mode);
+    std::string error;
+    if (!sim.Open("", error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    sim.SetTelemetryRate(opt.rate);
+    sim.SetBaudRate(opt.baud);
+    sim.SetFaults(opt.faults);
+    sim.SetMaxBaudRate(opt.maxBaud);
+    sim.Start();
+
+    PipelineMetrics metrics;
+    EventQueue events;
+    BatteryLink link;
+    link.SetMetrics(&metrics);
+    // 读到数据到投递事件的时间由 BatteryLink 记录
+    link.SetRawHandler([&](const uint8_t*, size_t length) {
+        events.Post(MetricsNow(), length);
+    });
+    link.SetErrorHandler([](const std::string& message) {
+        fprintf(stderr, "Link error: %s\n", message.c_str());
+    });
+    int baud = opt.baud > 0 ? opt.baud : 115200;
+    if (!link.Open(sim.GetPortName(), baud, opt.raw ? FRAME_TEXT : opt.mode, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    // 测试阶段：主线程充当界面线程
+    SendQueue* sendQueue = opt.raw ? new SendQueue(link, metrics) : nullptr;
+    CommandLoad* commands = nullptr;
+    if (!opt.raw && opt.window > 0) {
+        commands = new CommandLoad(link.GetEngine());
+        commands->Start(opt.window);
+    }
+
+    MetricsSnapshot first = metrics.Snapshot();
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::milliseconds(static_cast<int64_t>(opt.seconds * 1000));
+    Clock::time_point nextPoll = start;
+    uint32_t telemetryVersion = 0;
+    uint64_t sent = 0;
+    size_t uiBytes = 0;
+    TelemetryRecord rec;
+    while (Clock::now() < end) {
+        Clock::time_point now = Clock::now();
+        uiBytes += events.Drain(metrics.eventToUi);
+        if (now >= nextPoll) {
+            link.GetTelemetry().Fetch(telemetryVersion, rec);
+            nextPoll += std::chrono::milliseconds(100);
+        }
+        if (sendQueue) {
+            uint64_t due = static_cast<uint64_t>(std::chrono::duration<double>(now - start).count() * opt.txRate);
+            for (; sent < due; sent++) {
+                char line[64];
+                snprintf(line, sizeof(line), "loadtest line %llu\n", (unsigned long long)sent);
+                sendQueue->Push(line);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (commands) commands->Stop();
+    MetricsSnapshot last = metrics.Snapshot();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    delete sendQueue;
+
+    double rxRate = MetricsRate(last.rxBytes, first.rxBytes, last.time, first.time);
+    double txRate = MetricsRate(last.txBytes, first.txBytes, last.time, first.time);
+    uint32_t telemetry = link.GetTelemetry().GetReceived();
+    printf("duration %.2f s, framing %s, baud %d\n", seconds, opt.raw ? "raw" : "binary", opt.baud);
+    printf("rx %.0f B/s, tx %.0f B/s, dropped %llu B\n", rxRate, txRate, (unsigned long long)last.droppedBytes);
+    if (opt.raw) {
+        printf("raw events %llu, %zu bytes shown\n", (unsigned long long)last.eventToUi.count, uiBytes);
+    } else {
+        printf("telemetry %u frames, %.0f frames/s\n", telemetry, telemetry / seconds);
+    }
+    PrintLatency("read->event", last.readToEvent);
+    PrintLatency("event->ui", last.eventToUi);
+    PrintLatency("enqueue->write", last.enqueueToWrite);
+
+    bool ok = true;
+    HistogramSnapshot rtt = {};
+    uint64_t completed = 0, failed = 0;
+    if (commands) {
+        rtt = commands->roundTrip.Snapshot();
+        completed = commands->completed;
+        failed = commands->failed;
+        printf("commands %llu ok, %llu failed, %.0f/s, rtt %s\n",
+               (unsigned long long)completed, (unsigned long long)failed, completed / seconds,
+               FormatLatency(rtt).c_str());
+        bool faulty = opt.faults.corruptRate > 0 || opt.faults.garbageRate > 0;
+        if (failed > 0 && !faulty) ok = false;
+        if (opt.maxRttUs > 0 && rtt.Percentile(0.99) > opt.maxRttUs) ok = false;
+    }
+
+    // 命令负载停下后等在途命令结束，再单独测 OTA
+    double otaRate = 0;
+    std::string otaMessage;
+    if (opt.otaSize > 0 && !opt.raw) {
+        while (link.GetEngine()->GetInFlight() > 0 || link.GetEngine()->GetPending() > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        sim.SetTelemetryRate(0);
+        BaudNegotiator speed(link.GetEngine(), [&](int b) { return link.SetBaudRate(b); }, baud);
+        std::string speedMessage;
+        if (opt.fast) {
+            Clock::time_point negotiateStart = Clock::now();
+            if (!ChangeSpeed(speed, true, speedMessage)) ok = false;
+            printf("negotiate: %s, %.0f ms\n", speedMessage.c_str(),
+                   std::chrono::duration<double, std::milli>(Clock::now() - negotiateStart).count());
+        }
+        bool otaOk = RunOta(link, opt.otaSize, otaRate, otaMessage);
+        printf("ota %zu bytes at %d baud: %s, %.0f B/s\n", opt.otaSize, link.GetBaudRate(), otaMessage.c_str(), otaRate);
+        // 提速后下载失败的，切回原速率再降一档重试
+        for (int attempt = 1; opt.fast && !otaOk && link.GetBaudRate() != baud && attempt < MAX_OTA_ATTEMPTS; attempt++) {
+            int failedBaud = link.GetBaudRate();
+            if (!ChangeSpeed(speed, false, speedMessage)) break;
+            speed.LimitBelow(failedBaud);
+            if (!ChangeSpeed(speed, true, speedMessage)) break;
+            printf("retry: %s\n", speedMessage.c_str());
+            otaOk = RunOta(link, opt.otaSize, otaRate, otaMessage);
+            printf("ota %zu bytes at %d baud: %s, %.0f B/s\n", opt.otaSize, link.GetBaudRate(), otaMessage.c_str(), otaRate);
+        }
+        if (!otaOk) ok = false;
+        if (opt.fast) {
+            if (!ChangeSpeed(speed, false, speedMessage) || link.GetBaudRate() != baud) ok = false;
+            printf("restore: %s\n", speedMessage.c_str());
+        }
+    }
+    if (opt.minRx > 0 && rxRate < opt.minRx) ok = false;
+
+    SimulatorStats simStats = sim.GetStats();
+    printf("simulator: telemetry %llu, commands %llu, corrupted %llu, garbage %llu bytes, baud changes %u, reverts %u\n",
+           (unsigned long long)simStats.telemetrySent, (unsigned long long)simStats.commandsHandled,
+           (unsigned long long)simStats.corruptedFrames, (unsigned long long)simStats.garbageBytes,
+           simStats.baudChanges, simStats.baudReverts);
+
+    if (!opt.jsonPath.empty()) {
+        std::string json = FormatMetricsJson(last, first);
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer),
+                 ",\"seconds\":%.3f,\"telemetry_frames\":%u,\"commands_ok\":%llu,\"commands_failed\":%llu,"
+                 "\"command_rtt_p50_us\":%.0f,\"command_rtt_p99_us\":%.0f,\"ota_bytes_per_second\":%.0f,\"passed\":%s}\n",
+                 seconds, telemetry, (unsigned long long)completed, (unsigned long long)failed,
+                 rtt.Percentile(0.5), rtt.Percentile(0.99), otaRate, ok ? "true" : "false");
+        // 去掉 FormatMetricsJson 结尾的 "}\n"，接上压力测试自己的字段
+        json.erase(json.size() - 2);
+        json += buffer;
+        if (!WriteMetricsFile(opt.jsonPath, json)) {
+            fprintf(stderr, "Failed to write %s\n", opt.jsonPath.c_str());
+        }
+    }
+
+    link.Close();
+    delete commands;
+    sim.Stop();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+// log_index.h
+// 日志索引：按行保存全部日志文本，边追加边建三字母组（trigram）倒排索引
+//
+// 每 64 行为一个块，倒排表记录含有某个三字母组的块号（不区分大小写）。
+// 查找子串时先取模式里的三字母组求块的交集，只在候选块里逐行比较；
+// 正则表达式取其中必须出现的几段字面量做同样的预筛选，逐行比较时也先查字面量，
+// 都出现了才执行正则。
+// 几百万行的日志查找通常只需要几毫秒，新追加的行可以从指定行号开始增量查找。
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <regex>
+#include <algorithm>
+#include <unordered_map>
+
+// 编译好的过滤条件
+class LogMatcher {
+public:
+    LogMatcher() : useRegex(false), ignoreCase(false) {}
+
+    // 编译失败（正则语法错误）时返回 false
+    bool Compile(const std::string& text, bool isRegex, bool noCase, std::string& error) {
+        pattern = text;
+        useRegex = isRegex;
+        ignoreCase = noCase;
+        literals.clear();
+        if (isRegex) {
+            RequiredLiterals(text, literals);
+        } else if (!text.empty()) {
+            literals.push_back(text);
+        }
+        if (useRegex) {
+            try {
+                std::regex::flag_type flags = std::regex::ECMAScript | std::regex::optimize;
+                if (ignoreCase) flags |= std::regex::icase;
+                regex.assign(text, flags);
+            } catch (const std::regex_error& e) {
+                error = e.what();
+                return false;
+            }
+        }
+        folded = literals;
+        for (size_t k = 0; k < folded.size(); k++) {
+            for (size_t i = 0; i < folded[k].size(); i++) folded[k][i] = Fold(folded[k][i]);
+        }
+        return true;
+    }
+
+    bool IsEmpty() const { return pattern.empty(); }
+
+    // 预筛选用的字面量（已转小写），可能为空
+    const std::vector<std::string>& GetLiterals() const { return folded; }
+
+    bool Match(const char* line, size_t length) const {
+        const char* end = line + length;
+        for (size_t k = 0; k < literals.size(); k++) {
+            bool found = ignoreCase
+                ? std::search(line, end, folded[k].begin(), folded[k].end(),
+                              [](char a, char b) { return Fold(a) == b; }) != end
+                : std::search(line, end, literals[k].begin(), literals[k].end()) != end;
+            if (!found) return false;
+        }
+        return !useRegex || std::regex_search(line, end, regex);
+    }
+
+    static char Fold(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+private:
+    // 从正则中找出匹配结果里一定出现的各段字面量（至少 3 个字符）
+    // 只看最外层：有顶层 | 时放弃；分组、字符集、元字符都会截断字面量
+    static void RequiredLiterals(const std::string& re, std::vector<std::string>& out) {
+        std::vector<std::string> found;
+        std::string run;
+        int depth = 0;
+        for (size_t i = 0; i < re.size(); i++) {
+            char c = re[i];
+            char next = i + 1 < re.size() ? re[i + 1] : 0;
+            bool literalChar = false;
+            if (c == '\\') {
+                // \. \( 等转义的标点是字面量，\d \w 等字符类不是
+                if (next && !isalnum(static_cast<unsigned char>(next))) {
+                    c = next;
+                    literalChar = depth == 0;
+                }
+                i++;
+                // \xhh \uhhhh \cX 后面的字符属于转义本身
+                if (next == 'x') i += 2;
+                else if (next == 'u') i += 4;
+                else if (next == 'c') i += 1;
+                next = i + 1 < re.size() ? re[i + 1] : 0;
+            } else if (c == '[') {
+                // 跳过字符集
+                for (i++; i < re.size() && re[i] != ']'; i++) {
+                    if (re[i] == '\\') i++;
+                }
+                next = i + 1 < re.size() ? re[i + 1] : 0;
+            } else if (c == '{') {
+                // 跳过 {n,m}
+                while (i < re.size() && re[i] != '}') i++;
+                next = i + 1 < re.size() ? re[i + 1] : 0;
+            } else if (c == '(') {
+                depth++;
+            } else if (c == ')') {
+                depth--;
+            } else if (c == '|') {
+                if (depth == 0) return;
+            } else if (!strchr(".^$*+?{}", c)) {
+                literalChar = depth == 0;
+            }
+
+            if (literalChar && next != '*' && next != '?' && next != '{') {
+                run += c;
+                // a+ 至少出现一次，但后面的字符不一定紧跟着它
+                if (next == '+') {
+                    if (run.size() >= 3) found.push_back(run);
+                    run.clear();
+                }
+                continue;
+            }
+            if (run.size() >= 3) found.push_back(run);
+            run.clear();
+        }
+        if (run.size() >= 3) found.push_back(run);
+        out.swap(found);
+    }
+
+    std::string pattern;
+    std::vector<std::string> literals;
+    std::vector<std::string> folded;
+    bool useRegex;
+    bool ignoreCase;
+    std::regex regex;
+};
+
+class LogIndex {
+public:
+    static const size_t BLOCK_LINES = 64;
+    static const size_t CHUNK_SIZE = 1024 * 1024;
+
+    LogIndex() {}
+
+    // 追加一段文本，按 '\n' 切行；最后不完整的一行等后续文本补齐后才进入索引
+    // timeMs 为这段文本到达的时间（纪元毫秒）
+    void Append(const char* text, size_t length, int64_t timeMs) {
+        const char* end = text + length;
+        while (text < end) {
+            const char* newline = static_cast<const char*>(memchr(text, '\n', end - text));
+            if (!newline) {
+                if (partial.empty()) partialTime = timeMs;
+                partial.append(text, end);
+                return;
+            }
+            if (partial.empty()) {
+                AddLine(text, newline - text, timeMs);
+            } else {
+                partial.append(text, newline);
+                AddLine(partial.data(), partial.size(), partialTime);
+                partial.clear();
+            }
+            text = newline + 1;
+        }
+    }
+
+    void Clear() {
+        chunks.clear();
+        lines.clear();
+        postings.clear();
+        partial.clear();
+    }
+
+    size_t GetLineCount() const { return lines.size(); }
+
+    const char* GetLine(size_t line, size_t& length) const {
+        const Line& l = lines[line];
+        length = l.length;
+        return chunks[l.chunk].data() + l.offset;
+    }
+
+    int64_t GetLineTime(size_t line) const { return lines[line].time; }
+
+    // 从 firstLine 开始查找匹配的行，行号按升序追加到 out，返回实际比较的行数
+    size_t Search(const LogMatcher& matcher, size_t firstLine, std::vector<uint32_t>& out) const {
+        if (firstLine >= lines.size()) return 0;
+        size_t firstBlock = firstLine / BLOCK_LINES;
+        size_t blockCount = (lines.size() + BLOCK_LINES - 1) / BLOCK_LINES;
+
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> keys;
+        const std::vector<std::string>& literals = matcher.GetLiterals();
+        for (size_t k = 0; k < literals.size(); k++) {
+            for (size_t i = 0; i + 3 <= literals[k].size(); i++) keys.push_back(Trigram(literals[k].data() + i));
+        }
+        if (!keys.empty()) {
+            Intersect(keys, static_cast<uint32_t>(firstBlock), candidates);
+        } else {
+            // 太短，没有可用的三字母组，逐块扫描
+            for (size_t b = firstBlock; b < blockCount; b++) candidates.push_back(static_cast<uint32_t>(b));
+        }
+
+        size_t compared = 0;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            size_t begin = std::max(firstLine, candidates[i] * BLOCK_LINES);
+            size_t end = std::min(lines.size(), (candidates[i] + 1) * BLOCK_LINES);
+            for (size_t line = begin; line < end; line++) {
+                size_t length;
+                const char* text = GetLine(line, length);
+                compared++;
+                if (matcher.Match(text, length)) out.push_back(static_cast<uint32_t>(line));
+            }
+        }
+        return compared;
+    }
+
+private:
+    struct Line {
+        uint32_t chunk;
+        uint32_t offset;
+        uint32_t length;
+        int64_t time;
+    };
+
+    static uint32_t Trigram(const char* p) {
+        return (static_cast<uint32_t>(static_cast<uint8_t>(LogMatcher::Fold(p[0]))) << 16) |
+               (static_cast<uint32_t>(static_cast<uint8_t>(LogMatcher::Fold(p[1]))) << 8) |
+               static_cast<uint8_t>(LogMatcher::Fold(p[2]));
+    }
+
+    void AddLine(const char* text, size_t length, int64_t timeMs) {
+        // 行文本存到 1MB 的块里，一行不跨块；超长的行单独占一块
+        if (chunks.empty() || chunks.back().size() + length > chunks.back().capacity()) {
+            chunks.push_back(std::string());
+            chunks.back().reserve(std::max(CHUNK_SIZE, length));
+        }
+        std::string& chunk = chunks.back();
+        Line line;
+        line.chunk = static_cast<uint32_t>(chunks.size() - 1);
+        line.offset = static_cast<uint32_t>(chunk.size());
+        line.length = static_cast<uint32_t>(length);
+        line.time = timeMs;
+        chunk.append(text, length);
+
+        uint32_t block = static_cast<uint32_t>(lines.size() / BLOCK_LINES);
+        lines.push_back(line);
+        for (size_t i = 0; i + 3 <= length; i++) {
+            std::vector<uint32_t>& list = postings[Trigram(text + i)];
+            // 块号递增，同一块只记一次
+            if (list.empty() || list.back() != block) list.push_back(block);
+        }
+    }
+
+    // 含有全部三字母组、且不早于 firstBlock 的块
+    void Intersect(const std::vector<uint32_t>& keys, uint32_t firstBlock, std::vector<uint32_t>& out) const {
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (size_t i = 0; i < keys.size(); i++) {
+            std::unordered_map<uint32_t, std::vector<uint32_t> >::const_iterator it = postings.find(keys[i]);
+            if (it == postings.end()) return;
+            lists.push_back(&it->second);
+        }
+        // 从最短的表开始，在其余的表里二分查找
+        std::sort(lists.begin(), lists.end(),
+                  [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) { return a->size() < b->size(); });
+        const std::vector<uint32_t>& shortest = *lists[0];
+        std::vector<std::vector<uint32_t>::const_iterator> cursors;
+        for (size_t k = 1; k < lists.size(); k++) cursors.push_back(lists[k]->begin());
+
+        for (std::vector<uint32_t>::const_iterator it = std::lower_bound(shortest.begin(), shortest.end(), firstBlock);
+             it != shortest.end(); ++it) {
+            bool all = true;
+            for (size_t k = 1; k < lists.size() && all; k++) {
+                cursors[k - 1] = std::lower_bound(cursors[k - 1], lists[k]->end(), *it);
+                all = cursors[k - 1] != lists[k]->end() && *cursors[k - 1] == *it;
+            }
+            if (all) out.push_back(*it);
+        }
+    }
+
+    std::vector<std::string> chunks;
+    std::vector<Line> lines;
+    std::unordered_map<uint32_t, std::vector<uint32_t> > postings;
+    std::string partial;
+    int64_t partialTime;
+};
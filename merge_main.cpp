@@ -8,38 +8,12 @@
 #include <wx/image.h>
 #include <vector>
 #include <sstream>
+#include <thread>
+#include "image_compare.h"
 
 #if 1
-// 定义 crc32_calc 函数
-#include <stdint.h>
-#include <stddef.h>
-
-// CRC32 表
-static uint32_t crc32_table[256];
-
-// 初始化 CRC32 表
-void crc32_init() {
-    for (uint32_t i = 0; i < 256; i++) {
-        uint32_t crc = i;
-        for (uint32_t j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320; // 反转多项式原始形式是0x04C11DB7
-            } else {
-                crc >>= 1;
-            }
-        }
-        crc32_table[i] = crc;
-    }
-}
-
-// 计算 CRC32
-uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc) {
-    for (size_t i = 0; i < length; i++) {
-        uint8_t byte = data[i];
-        crc = (crc >> 8) ^ crc32_table[(crc ^ byte) & 0xFF];
-    }
-    return ~crc; // 取反
-}
+// crc32 定义在 crc32.h，串口工具也用它计算块校验
+#include "crc32.h"
 #else
 
 static uint32_t crc32(const uint8_t * src, unsigned len, unsigned state)
@@ -75,8 +49,6 @@ uint32_t calculate_crc32(const std::string& filename, size_t *outputFileSize) {
         return 0;
     }
 
-    crc32_init();
-
     fileApp.seekg(0, std::ios::end);
     std::streamsize fileSize = fileApp.tellg();
     fileApp.seekg(0, std::ios::beg);
@@ -99,6 +71,7 @@ public:
 class MergeFrame : public wxFrame {
 public:
     MergeFrame();
+    ~MergeFrame();
 
 private:
     void OnSelectFile1(wxCommandEvent& event);
@@ -108,6 +81,10 @@ private:
     void UpdateLogText(const wxString& message);
     void OnCrc32(wxCommandEvent& event);
     void OnOta(wxCommandEvent& event);
+    void OnCompare(wxCommandEvent& event);
+    void OnCompareResult(wxThreadEvent& event);
+    void OnCompareDone(wxThreadEvent& event);
+    ImageLayout MergeLayout();
 
     wxTextCtrl* file1Path;
     wxTextCtrl* file2Path;
@@ -115,6 +92,8 @@ private:
     wxTextCtrl* file2AddrEntry;
     wxTextCtrl* logText;
     wxStatusBar* statusBar;
+    wxButton* compareButton;
+    std::thread* compareThread;
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -124,7 +103,10 @@ enum {
     ID_FILE2_SELECT,
     ID_MERGE,
     ID_CRC,
-    ID_OTA
+    ID_OTA,
+    ID_COMPARE,
+    ID_COMPARE_RESULT,
+    ID_COMPARE_DONE
 };
 
 wxBEGIN_EVENT_TABLE(MergeFrame, wxFrame)
@@ -133,6 +115,9 @@ wxBEGIN_EVENT_TABLE(MergeFrame, wxFrame)
     EVT_BUTTON(ID_MERGE, MergeFrame::OnMerge)
     EVT_BUTTON(ID_CRC, MergeFrame::OnCrc32)
     EVT_BUTTON(ID_OTA, MergeFrame::OnOta)
+    EVT_BUTTON(ID_COMPARE, MergeFrame::OnCompare)
+    EVT_THREAD(ID_COMPARE_RESULT, MergeFrame::OnCompareResult)
+    EVT_THREAD(ID_COMPARE_DONE, MergeFrame::OnCompareDone)
 wxEND_EVENT_TABLE()
 
 wxIMPLEMENT_APP(MergeApp);
@@ -143,7 +128,7 @@ bool MergeApp::OnInit() {
     return true;
 }
 
-MergeFrame::MergeFrame() : wxFrame(nullptr, wxID_ANY, "Binary File Merger", wxDefaultPosition, wxSize(800, 600)) {
+MergeFrame::MergeFrame() : wxFrame(nullptr, wxID_ANY, "Binary File Merger", wxDefaultPosition, wxSize(800, 600)), compareThread(nullptr) {
     // 加载图标
     wxIcon icon("icon.ico", wxBITMAP_TYPE_ICO);
     SetIcon(icon);
@@ -187,11 +172,13 @@ MergeFrame::MergeFrame() : wxFrame(nullptr, wxID_ANY, "Binary File Merger", wxDe
     wxButton* mergeButton = new wxButton(panel, ID_MERGE, "Merge");
     wxButton* crcButton = new wxButton(panel, ID_CRC, "CRC32");
     wxButton* otaButton = new wxButton(panel, ID_OTA, "Make OTA bin");
+    compareButton = new wxButton(panel, ID_COMPARE, "Compare readback");
 
     wxBoxSizer* buttonSizer = new wxBoxSizer(wxHORIZONTAL);
     buttonSizer->Add(mergeButton, 0, wxALIGN_CENTER | wxALL, 5);
     buttonSizer->Add(crcButton, 0, wxALIGN_CENTER | wxALL, 5);
     buttonSizer->Add(otaButton, 0, wxALIGN_CENTER | wxALL, 5);
+    buttonSizer->Add(compareButton, 0, wxALIGN_CENTER | wxALL, 5);
     vbox->Add(buttonSizer, 0, wxALIGN_CENTER | wxALL, 5);
 
     // 创建一个TEXT多行编辑框，用于显示提示信息
@@ -206,6 +193,13 @@ MergeFrame::MergeFrame() : wxFrame(nullptr, wxID_ANY, "Binary File Merger", wxDe
     panel->Layout(); 
 }
 
+MergeFrame::~MergeFrame() {
+    if (compareThread) {
+        compareThread->join();
+        delete compareThread;
+    }
+}
+
 void MergeFrame::OnSelectFile1(wxCommandEvent& event) {
     wxFileDialog openFileDialog(this, "Select First Binary File", "", "", "Binary files (*.bin)|*.bin", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
     if (openFileDialog.ShowModal() == wxID_OK) {
@@ -374,6 +368,89 @@ void MergeFrame::OnMerge(wxCommandEvent& event) {
     UpdateStatus("Merge completed successfully.");
 }
 
+// 按当前选择的文件和地址得到 merged.bin 的布局，没有选择文件时不分段
+ImageLayout MergeFrame::MergeLayout() {
+    if (file1Path->GetValue().IsEmpty() || file2Path->GetValue().IsEmpty()) return ImageLayout();
+    long file2OffsetValue = 0;
+    file2AddrEntry->GetValue().ToLong(&file2OffsetValue, 16);
+    std::ifstream inputFile1(file1Path->GetValue().ToStdString(), std::ios::binary | std::ios::ate);
+    std::ifstream inputFile2(file2Path->GetValue().ToStdString(), std::ios::binary | std::ios::ate);
+    if (!inputFile1 || !inputFile2) return ImageLayout();
+    return ImageLayout::FromMerge(static_cast<uint64_t>(inputFile1.tellg()), static_cast<uint64_t>(file2OffsetValue),
+                                  static_cast<uint64_t>(inputFile2.tellg()));
+}
+
+// 选择一批回读文件与 merged.bin 比较，在后台线程中进行，每个文件的结果完成后即显示
+void MergeFrame::OnCompare(wxCommandEvent& event) {
+    if (compareThread) return;
+    wxFileDialog openFileDialog(this, "Select Readback Files", "", "", "Binary files (*.bin)|*.bin",
+                                wxFD_OPEN | wxFD_FILE_MUST_EXIST | wxFD_MULTIPLE);
+    if (openFileDialog.ShowModal() != wxID_OK) return;
+    wxArrayString files;
+    openFileDialog.GetPaths(files);
+    if (files.empty()) return;
+
+    MappedFile* reference = new MappedFile();
+    std::string error;
+    if (!reference->Open("merged.bin", error)) {
+        delete reference;
+        UpdateLogText("\n" + error);
+        UpdateStatus("Please merge first.");
+        return;
+    }
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < files.size(); i++) paths.push_back(files[i].ToStdString());
+    ImageLayout layout = MergeLayout();
+
+    UpdateLogText("\nCompare " + std::to_string(paths.size()) + " readback files with merged.bin...");
+    UpdateStatus("Comparing...");
+    compareButton->Disable();
+    compareThread = new std::thread([this, reference, layout, paths]() {
+        std::atomic<size_t> failed(0);
+        std::atomic<uint64_t> totalBytes(0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        ImageBatch batch(*reference, layout);
+        batch.SetMaxRegions(20);
+        batch.Run(paths, std::thread::hardware_concurrency(),
+                  [&](size_t index, const CompareResult& r, const std::string& error) {
+            wxThreadEvent* e = new wxThreadEvent(wxEVT_THREAD, ID_COMPARE_RESULT);
+            if (!error.empty()) {
+                failed++;
+                e->SetString("ERROR " + paths[index] + ": " + error);
+            } else {
+                if (!r.Identical()) failed++;
+                totalBytes += r.imageSize;
+                e->SetString(FormatCompareReport(paths[index], r));
+            }
+            wxQueueEvent(this, e);
+        });
+        delete reference;
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        char summary[160];
+        snprintf(summary, sizeof(summary), "%zu files, %zu failed, %.1f MB compared in %.3f s (%.0f MB/s)",
+                 paths.size(), failed.load(), totalBytes / 1e6, seconds, seconds > 0 ? totalBytes / 1e6 / seconds : 0.0);
+        wxThreadEvent* e = new wxThreadEvent(wxEVT_THREAD, ID_COMPARE_DONE);
+        e->SetString(summary);
+        e->SetInt(failed.load() == 0);
+        wxQueueEvent(this, e);
+    });
+}
+
+void MergeFrame::OnCompareResult(wxThreadEvent& event) {
+    UpdateLogText(event.GetString());
+}
+
+void MergeFrame::OnCompareDone(wxThreadEvent& event) {
+    compareThread->join();
+    delete compareThread;
+    compareThread = nullptr;
+    compareButton->Enable();
+    UpdateLogText(event.GetString());
+    UpdateStatus(event.GetInt() ? "All readback files match." : "Readback mismatch found.");
+}
+
 void MergeFrame::UpdateStatus(const wxString& message) {
     statusBar->SetStatusText(message);
 }
\ No newline at end of file
@@ -0,0 +1,421 @@
+// ota_transfer.h
+// 串口固件下载
+//
+// OtaTransfer：按窗口流水线发送整个 OTA 镜像，只重发超时的数据块
+//   CMD_OTA_BEGIN -> 多个 CMD_OTA_DATA（窗口内并发，按偏移寻址）-> CMD_OTA_END
+//
+// FlashDiffUpdate：先读设备每个 flash 块的 CRC32，与主机计算的块 CRC 表比较，
+//   只重写不一致的块，写完再读一遍 CRC 校验。中途断开后重新执行即可续传，
+//   已经写好的块 CRC 一致，不会再发送。
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <functional>
+#include "command_engine.h"
+#include "crc32.h"
+
+// 下载进度
+struct OtaProgress {
+    size_t bytesDone;       // 已确认的字节数
+    size_t total;
+    double seconds;         // 已用时间
+    double bytesPerSecond;  // 有效吞吐（只算已确认的镜像字节）
+    uint32_t retransmits;
+};
+
+// 固件任务基类：进度统计、结束通知和中止
+// 任务的命令都带着自己的 owner 提交，结束时只取消自己的命令；
+// 所有命令的回调都返回后才调用结束回调，此后不再访问任务对象，收到通知的一方可以删除它
+class FirmwareJob {
+public:
+    typedef std::function<void(const OtaProgress&)> ProgressHandler;
+    typedef std::function<void(bool ok, const std::string& message)> DoneHandler;
+    typedef std::chrono::steady_clock Clock;
+
+    FirmwareJob(CommandEngine* engine, const std::vector<uint8_t>& image, size_t window)
+        : engine(engine), image(image), window(window), baudRate(115200),
+          bytesDone(0), total(0), finished(false), startRetransmits(0),
+          outstanding(0), notified(false), resultOk(false) {}
+    virtual ~FirmwareJob() {}
+
+    // 串口波特率，用来估算命令超时
+    void SetBaudRate(int baud) { baudRate = baud > 0 ? baud : 115200; }
+
+    void SetProgressHandler(const ProgressHandler& h) { onProgress = h; }
+    void SetDoneHandler(const DoneHandler& h) { onDone = h; }
+
+    // 开始任务，立即返回，结果通过回调通知
+    virtual void Start() = 0;
+
+    // 中止任务，取消本任务未完成的命令，其他模块提交的命令不受影响
+    void Abort() { Finish(false, "Download aborted"); }
+
+    // 结束回调已经调用，任务不再有未返回的命令回调，可以删除
+    bool IsFinished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return notified;
+    }
+
+protected:
+    void BeginTiming(size_t totalBytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        startTime = Clock::now();
+        lastReport = startTime;
+        startRetransmits = engine->GetRetransmits();
+        bytesDone = 0;
+        total = totalBytes;
+    }
+
+    // 记录已确认的字节，进度最多每 100ms 报告一次；任务已结束时返回 false
+    bool AddProgress(size_t bytes) {
+        bool report = false;
+        OtaProgress progress;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return false;
+            bytesDone += bytes;
+            Clock::time_point now = Clock::now();
+            if (bytesDone >= total || now - lastReport >= std::chrono::milliseconds(100)) {
+                lastReport = now;
+                progress = MakeProgress(now);
+                report = true;
+            }
+        }
+        if (report && onProgress) onProgress(progress);
+        return true;
+    }
+
+    // 提交本任务的一条命令，任务已结束时不提交并返回 false
+    bool Send(uint8_t command, const std::vector<uint8_t>& payload, const CommandEngine::Completion& done,
+              int timeoutMs, int retries, uint32_t tag = 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return false;
+            // 一份给命令回调，一份保证本函数返回前不会通知结束
+            outstanding += 2;
+        }
+        engine->Submit(command, payload, [this, done](const CommandResult& r) {
+            done(r);
+            Release();
+        }, timeoutMs, retries, tag, this);
+        // 提交的同时任务在其他线程结束了，Finish 里的取消可能没有覆盖到这一条
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = finished;
+        }
+        if (stop) engine->Cancel(this);
+        Release();
+        return true;
+    }
+
+    // 命令失败时结束任务，其余的命令由 Finish 取消
+    void Fail(const CommandResult& r, const char* what) {
+        Finish(false, std::string(what) + " " + CommandStatusName(r.status));
+    }
+
+    // 只有第一次调用生效，返回是否由本次调用结束
+    // 取消本任务其余的命令，等它们的回调全部返回后才调用结束回调
+    bool Finish(bool ok, const std::string& message) {
+        OtaProgress progress;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return false;
+            finished = true;
+            resultOk = ok;
+            resultMessage = message;
+            outstanding++;
+            progress = MakeProgress(Clock::now());
+        }
+        if (onProgress) onProgress(progress);
+        engine->Cancel(this);
+        Release();
+        return true;
+    }
+
+    // 命令超时：最坏情况下整个窗口都排在它前面发送，按线路速率估算后留出余量
+    int TimeoutMs(size_t frameBytes, int deviceMs) const {
+        size_t windowBytes = window * (frameBytes + 16);
+        size_t lineMs = windowBytes * 10 * 1000 / baudRate;
+        return static_cast<int>(200 + deviceMs + lineMs * 2);
+    }
+
+    CommandEngine* engine;
+    std::vector<uint8_t> image;
+    size_t window;
+    int baudRate;
+
+    std::mutex mutex;
+    size_t bytesDone;
+    size_t total;
+    bool finished;
+
+private:
+    // 持锁调用
+    OtaProgress MakeProgress(Clock::time_point now) const {
+        OtaProgress p;
+        p.bytesDone = bytesDone;
+        p.total = total;
+        p.seconds = std::chrono::duration<double>(now - startTime).count();
+        p.bytesPerSecond = p.seconds > 0 ? bytesDone / p.seconds : 0;
+        p.retransmits = engine->GetRetransmits() - startRetransmits;
+        return p;
+    }
+
+    // 最后一个未返回的回调结束且任务已结束时通知；通知之后不再访问本对象
+    void Release() {
+        DoneHandler done;
+        bool ok;
+        std::string message;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--outstanding > 0 || !finished) return;
+            notified = true;
+            done = onDone;
+            ok = resultOk;
+            message = resultMessage;
+        }
+        if (done) done(ok, message);
+    }
+
+    uint32_t startRetransmits;
+    Clock::time_point startTime;
+    Clock::time_point lastReport;
+    size_t outstanding;         // 未返回的命令回调（以及正在执行的 Send / Finish）
+    bool notified;
+    bool resultOk;
+    std::string resultMessage;
+
+    ProgressHandler onProgress;
+    DoneHandler onDone;
+};
+
+// 整个镜像下载到设备的 OTA 下载区
+class OtaTransfer : public FirmwareJob {
+public:
+    OtaTransfer(CommandEngine* engine, const std::vector<uint8_t>& image,
+                size_t chunkSize = 256, size_t window = 16)
+        : FirmwareJob(engine, image, window), chunkSize(chunkSize), nextOffset(0) {}
+
+    void Start() {
+        BeginTiming(image.size());
+        nextOffset = 0;
+
+        std::vector<uint8_t> payload;
+        PutLe32(payload, static_cast<uint32_t>(image.size()));
+        PutLe16(payload, static_cast<uint16_t>(chunkSize));
+        engine->SetWindow(window);
+        // 设备收到 BEGIN 后要擦除下载区，超时给长一点
+        Send(CMD_OTA_BEGIN, payload, [this](const CommandResult& r) { OnBegin(r); }, 5000, 1);
+    }
+
+private:
+    void OnBegin(const CommandResult& r) {
+        if (r.status != CMD_STATUS_OK) {
+            Fail(r, "OTA begin");
+            return;
+        }
+        // 先填满窗口，之后每确认一块补发一块
+        for (size_t i = 0; i < window; i++) {
+            if (!SubmitNextChunk()) break;
+        }
+    }
+
+    // 提交下一个数据块，没有剩余数据时返回 false
+    bool SubmitNextChunk() {
+        size_t offset;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished || nextOffset >= image.size()) return false;
+            offset = nextOffset;
+            nextOffset += chunkSize;
+        }
+        size_t n = image.size() - offset < chunkSize ? image.size() - offset : chunkSize;
+
+        std::vector<uint8_t> payload;
+        payload.reserve(n + 4);
+        PutLe32(payload, static_cast<uint32_t>(offset));
+        payload.insert(payload.end(), image.begin() + offset, image.begin() + offset + n);
+        return Send(CMD_OTA_DATA, payload, [this](const CommandResult& r) { OnChunk(r); },
+                    TimeoutMs(chunkSize, 0), 5, static_cast<uint32_t>(n));
+    }
+
+    void OnChunk(const CommandResult& r) {
+        if (r.status != CMD_STATUS_OK) {
+            Fail(r, "OTA data");
+            return;
+        }
+        // tag 记录了这一块的长度
+        if (!AddProgress(r.tag)) return;
+
+        bool allDone;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            allDone = (bytesDone >= image.size());
+        }
+        if (allDone) {
+            // 设备在 END 时校验整个镜像（ota.bin 尾部带有长度和 CRC32）
+            Send(CMD_OTA_END, std::vector<uint8_t>(), [this](const CommandResult& r) {
+                Finish(r.status == CMD_STATUS_OK, std::string("OTA verify ") + CommandStatusName(r.status));
+            }, 5000, 1);
+        } else {
+            SubmitNextChunk();
+        }
+    }
+
+    size_t chunkSize;
+    size_t nextOffset;
+};
+
+// 按块比较 CRC，只重写内容不同的 flash 块
+class FlashDiffUpdate : public FirmwareJob {
+public:
+    static const size_t CRC_BATCH = 64;     // 每条查询命令读取的块数
+    static const int MAX_ROUNDS = 3;        // 写入后校验仍不一致时最多重写几轮
+
+    FlashDiffUpdate(CommandEngine* engine, const std::vector<uint8_t>& image, uint32_t baseAddress,
+                    size_t blockSize = 1024, size_t window = 8)
+        : FirmwareJob(engine, image, window), baseAddress(baseAddress), blockSize(blockSize),
+          verifyOnly(false), round(0), pendingCommands(0), blocksWritten(0) {
+        // 末尾不足一块的部分按擦除后的 0xFF 补齐
+        blockCount = (image.size() + blockSize - 1) / blockSize;
+        this->image.resize(blockCount * blockSize, 0xFF);
+
+        // 主机侧块 CRC 表
+        hostCrc.resize(blockCount);
+        for (size_t i = 0; i < blockCount; i++) {
+            hostCrc[i] = crc32(&this->image[i * blockSize], blockSize, 0xFFFFFFFF);
+        }
+    }
+
+    // 只读 CRC 校验，有不一致的块时直接失败，不写入
+    void SetVerifyOnly(bool v) { verifyOnly = v; }
+
+    void Start() {
+        BeginTiming(0);
+        round = 0;
+        blocksWritten = 0;
+        engine->SetWindow(window);
+        QueryCrcs();
+    }
+
+private:
+    // 分批读取设备上所有块的 CRC，各批并发
+    void QueryCrcs() {
+        std::vector<std::vector<uint8_t> > payloads;
+        for (size_t first = 0; first < blockCount; first += CRC_BATCH) {
+            size_t count = blockCount - first < CRC_BATCH ? blockCount - first : CRC_BATCH;
+            std::vector<uint8_t> payload;
+            PutLe32(payload, static_cast<uint32_t>(baseAddress + first * blockSize));
+            PutLe16(payload, static_cast<uint16_t>(blockSize));
+            PutLe16(payload, static_cast<uint16_t>(count));
+            payloads.push_back(payload);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return;
+            dirty.assign(blockCount, false);
+            pendingCommands = payloads.size();
+        }
+        for (size_t i = 0; i < payloads.size(); i++) {
+            // 设备计算一批 CRC 需要读 64KB flash，超时留足
+            Send(CMD_FLASH_CRC, payloads[i], [this](const CommandResult& r) { OnCrcBatch(r); },
+                 TimeoutMs(CRC_BATCH * 4, 200), 3, static_cast<uint32_t>(i * CRC_BATCH));
+        }
+    }
+
+    void OnCrcBatch(const CommandResult& r) {
+        if (r.status != CMD_STATUS_OK) {
+            Fail(r, "Flash CRC");
+            return;
+        }
+
+        std::vector<size_t> toWrite;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return;
+            size_t first = r.tag;
+            size_t count = blockCount - first < CRC_BATCH ? blockCount - first : CRC_BATCH;
+            for (size_t i = 0; i < count; i++) {
+                // 应答长度不够时按不一致处理
+                bool same = (i * 4 + 4 <= r.response.size()) &&
+                            GetLe32(&r.response[i * 4]) == hostCrc[first + i];
+                dirty[first + i] = !same;
+            }
+            if (--pendingCommands > 0) return;
+
+            for (size_t i = 0; i < blockCount; i++) {
+                if (dirty[i]) toWrite.push_back(i);
+            }
+        }
+
+        if (toWrite.empty()) {
+            Finish(true, "Flash verified, " + std::to_string(blocksWritten) + " of " +
+                         std::to_string(blockCount) + " blocks rewritten");
+            return;
+        }
+        if (verifyOnly) {
+            Finish(false, "Flash verify failed, " + std::to_string(toWrite.size()) + " blocks differ");
+            return;
+        }
+        if (round >= MAX_ROUNDS) {
+            Finish(false, "Flash verify failed, blocks still differ");
+            return;
+        }
+        if (round == 0) {
+            // 第一轮的差异块数就是本次要传输的总量
+            BeginTiming(toWrite.size() * blockSize);
+        }
+        round++;
+        WriteBlocks(toWrite);
+    }
+
+    void WriteBlocks(const std::vector<size_t>& blocks) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) return;
+            pendingCommands = blocks.size();
+        }
+        for (size_t i = 0; i < blocks.size(); i++) {
+            size_t block = blocks[i];
+            std::vector<uint8_t> payload;
+            payload.reserve(blockSize + 4);
+            PutLe32(payload, static_cast<uint32_t>(baseAddress + block * blockSize));
+            payload.insert(payload.end(), image.begin() + block * blockSize, image.begin() + (block + 1) * blockSize);
+            // 整块写入是幂等的，重发或乱序都不会写坏
+            Send(CMD_FLASH_BLOCK, payload, [this](const CommandResult& r) { OnBlockWritten(r); },
+                 TimeoutMs(blockSize, 100), 5, static_cast<uint32_t>(block));
+        }
+    }
+
+    void OnBlockWritten(const CommandResult& r) {
+        if (r.status != CMD_STATUS_OK) {
+            Fail(r, "Flash write");
+            return;
+        }
+        if (!AddProgress(blockSize)) return;
+
+        bool verify;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocksWritten++;
+            verify = (--pendingCommands == 0);
+        }
+        // 本轮写完，重新读 CRC 校验
+        if (verify) QueryCrcs();
+    }
+
+    uint32_t baseAddress;
+    size_t blockSize;
+    size_t blockCount;
+    std::vector<uint32_t> hostCrc;
+    std::vector<bool> dirty;
+    bool verifyOnly;
+    int round;
+    size_t pendingCommands;
+    size_t blocksWritten;
+};
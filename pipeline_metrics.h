@@ -0,0 +1,274 @@
+// pipeline_metrics.h
+// 串口收发链路的计数器和延迟直方图
+//
+// 热路径上只做一次无竞争的原子加：每个线程固定写自己的分片，
+// 分片各占一条缓存行，读取时再把所有分片加起来。不加锁。
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+// 单调时钟，纳秒
+inline int64_t MetricsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const size_t METRICS_SHARDS = 16;
+
+// 当前线程固定使用的分片号
+inline size_t MetricsShard() {
+    static std::atomic<size_t> next(0);
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+    return shard;
+}
+
+class ShardedCounter {
+public:
+    ShardedCounter() {
+        for (size_t i = 0; i < METRICS_SHARDS; i++) shards[i].value.store(0, std::memory_order_relaxed);
+    }
+
+    void Add(uint64_t n) {
+        shards[MetricsShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t Get() const {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < METRICS_SHARDS; i++) sum += shards[i].value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value;
+    };
+    Shard shards[METRICS_SHARDS];
+};
+
+// 直方图快照：第 i 个桶统计 [2^(i-1), 2^i) 微秒，第 0 个桶是不到 1 微秒
+struct HistogramSnapshot {
+    static const int BUCKETS = 32;
+    uint64_t counts[BUCKETS];
+    uint64_t count;
+    uint64_t sumNs;
+    uint64_t maxNs;
+
+    // 分位数，返回所在桶的上限（微秒），不超过最大值
+    double Percentile(double p) const {
+        if (count == 0) return 0;
+        uint64_t target = static_cast<uint64_t>(count * p);
+        if (target >= count) target = count - 1;
+        uint64_t seen = 0;
+        double maxUs = maxNs / 1000.0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > target) {
+                double bound = static_cast<double>(1ULL << i);
+                return bound < maxUs ? bound : maxUs;
+            }
+        }
+        return maxUs;
+    }
+
+    double MeanUs() const { return count ? sumNs / 1000.0 / count : 0; }
+
+    // 与之前一次快照的差，即这段时间内的分布；最大值无法相减，仍是累计的最大值
+    HistogramSnapshot Since(const HistogramSnapshot& before) const {
+        HistogramSnapshot d = *this;
+        for (int i = 0; i < BUCKETS; i++) d.counts[i] -= before.counts[i];
+        d.count -= before.count;
+        d.sumNs -= before.sumNs;
+        return d;
+    }
+};
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() {
+        for (size_t s = 0; s < METRICS_SHARDS; s++) {
+            for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) shards[s].counts[i].store(0, std::memory_order_relaxed);
+            shards[s].sumNs.store(0, std::memory_order_relaxed);
+            shards[s].maxNs.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Record(int64_t ns) {
+        if (ns < 0) ns = 0;
+        uint64_t us = static_cast<uint64_t>(ns) / 1000;
+        int bucket = 0;
+        while (us > 0 && bucket < HistogramSnapshot::BUCKETS - 1) {
+            us >>= 1;
+            bucket++;
+        }
+        Shard& shard = shards[MetricsShard()];
+        shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        shard.sumNs.fetch_add(ns, std::memory_order_relaxed);
+        // 同一分片通常只有一个线程写，读-比较-写足够
+        if (static_cast<uint64_t>(ns) > shard.maxNs.load(std::memory_order_relaxed)) {
+            shard.maxNs.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    HistogramSnapshot Snapshot() const {
+        HistogramSnapshot snap = {};
+        for (size_t s = 0; s < METRICS_SHARDS; s++) {
+            for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+                uint64_t c = shards[s].counts[i].load(std::memory_order_relaxed);
+                snap.counts[i] += c;
+                snap.count += c;
+            }
+            snap.sumNs += shards[s].sumNs.load(std::memory_order_relaxed);
+            uint64_t m = shards[s].maxNs.load(std::memory_order_relaxed);
+            if (m > snap.maxNs) snap.maxNs = m;
+        }
+        return snap;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[HistogramSnapshot::BUCKETS];
+        std::atomic<uint64_t> sumNs;
+        std::atomic<uint64_t> maxNs;
+    };
+    Shard shards[METRICS_SHARDS];
+};
+
+// 一次读取的全部指标
+struct MetricsSnapshot {
+    int64_t time;
+    uint64_t rxBytes;
+    uint64_t txBytes;
+    uint64_t droppedBytes;
+    int64_t sendQueueDepth;
+    HistogramSnapshot readToEvent;
+    HistogramSnapshot eventToUi;
+    HistogramSnapshot enqueueToWrite;
+};
+
+// 串口收发链路的各阶段
+//   readToEvent:    读到数据 -> 交给处理方（更新遥测快照、完成命令、投递界面事件），由 BatteryLink 记录
+//   eventToUi:      投递事件 -> 界面显示完成
+//   enqueueToWrite: 放入发送队列 -> 写串口完成
+struct PipelineMetrics {
+    PipelineMetrics() : sendQueueDepth(0) {}
+
+    ShardedCounter rxBytes;
+    ShardedCounter txBytes;
+    ShardedCounter droppedBytes;    // 写失败丢弃的发送数据
+    std::atomic<int64_t> sendQueueDepth;
+    LatencyHistogram readToEvent;
+    LatencyHistogram eventToUi;
+    LatencyHistogram enqueueToWrite;
+
+    MetricsSnapshot Snapshot() const {
+        MetricsSnapshot s;
+        s.time = MetricsNow();
+        s.rxBytes = rxBytes.Get();
+        s.txBytes = txBytes.Get();
+        s.droppedBytes = droppedBytes.Get();
+        s.sendQueueDepth = sendQueueDepth.load(std::memory_order_relaxed);
+        s.readToEvent = readToEvent.Snapshot();
+        s.eventToUi = eventToUi.Snapshot();
+        s.enqueueToWrite = enqueueToWrite.Snapshot();
+        return s;
+    }
+};
+
+// 两次快照之间的速率（字节/秒）
+inline double MetricsRate(uint64_t now, uint64_t before, int64_t nowTime, int64_t beforeTime) {
+    if (nowTime <= beforeTime) return 0;
+    return (now - before) * 1e9 / (nowTime - beforeTime);
+}
+
+inline void AppendHistogramJson(std::string& out, const char* name, const HistogramSnapshot& h) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%.0f,\"p99_us\":%.0f,\"max_us\":%.1f}",
+             name, (unsigned long long)h.count, h.MeanUs(), h.Percentile(0.5), h.Percentile(0.99), h.maxNs / 1000.0);
+    out += buffer;
+}
+
+// 累计的直方图和 prev 以来这一段的直方图都导出，后者带 _interval 后缀
+inline std::string FormatMetricsJson(const MetricsSnapshot& s, const MetricsSnapshot& prev) {
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+             "{\"rx_bytes\":%llu,\"tx_bytes\":%llu,\"dropped_bytes\":%llu,\"send_queue_depth\":%lld,"
+             "\"rx_bytes_per_second\":%.1f,\"tx_bytes_per_second\":%.1f,",
+             (unsigned long long)s.rxBytes, (unsigned long long)s.txBytes, (unsigned long long)s.droppedBytes,
+             (long long)s.sendQueueDepth,
+             MetricsRate(s.rxBytes, prev.rxBytes, s.time, prev.time),
+             MetricsRate(s.txBytes, prev.txBytes, s.time, prev.time));
+    std::string out = buffer;
+    AppendHistogramJson(out, "read_to_event", s.readToEvent);
+    out += ",";
+    AppendHistogramJson(out, "event_to_ui", s.eventToUi);
+    out += ",";
+    AppendHistogramJson(out, "enqueue_to_write", s.enqueueToWrite);
+    out += ",";
+    AppendHistogramJson(out, "read_to_event_interval", s.readToEvent.Since(prev.readToEvent));
+    out += ",";
+    AppendHistogramJson(out, "event_to_ui_interval", s.eventToUi.Since(prev.eventToUi));
+    out += ",";
+    AppendHistogramJson(out, "enqueue_to_write_interval", s.enqueueToWrite.Since(prev.enqueueToWrite));
+    out += "}\n";
+    return out;
+}
+
+inline void AppendHistogramPrometheus(std::string& out, const char* name, const HistogramSnapshot& h) {
+    char buffer[160];
+    out += std::string("# TYPE serial_") + name + "_seconds histogram\n";
+    uint64_t cumulative = 0;
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        cumulative += h.counts[i];
+        snprintf(buffer, sizeof(buffer), "serial_%s_seconds_bucket{le=\"%g\"} %llu\n",
+                 name, (1ULL << i) / 1e6, (unsigned long long)cumulative);
+        out += buffer;
+    }
+    snprintf(buffer, sizeof(buffer), "serial_%s_seconds_bucket{le=\"+Inf\"} %llu\n"
+             "serial_%s_seconds_sum %g\nserial_%s_seconds_count %llu\n",
+             name, (unsigned long long)h.count, name, h.sumNs / 1e9, name, (unsigned long long)h.count);
+    out += buffer;
+}
+
+// 这一段的 p99 作为 gauge 导出，累计分布由 Prometheus 自己按时间窗口计算
+inline void AppendIntervalP99Prometheus(std::string& out, const char* name, const HistogramSnapshot& h) {
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "# TYPE serial_%s_interval_p99_seconds gauge\nserial_%s_interval_p99_seconds %g\n",
+             name, name, h.Percentile(0.99) / 1e6);
+    out += buffer;
+}
+
+inline std::string FormatMetricsPrometheus(const MetricsSnapshot& s, const MetricsSnapshot& prev) {
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+             "# TYPE serial_rx_bytes_total counter\nserial_rx_bytes_total %llu\n"
+             "# TYPE serial_tx_bytes_total counter\nserial_tx_bytes_total %llu\n"
+             "# TYPE serial_dropped_bytes_total counter\nserial_dropped_bytes_total %llu\n"
+             "# TYPE serial_send_queue_depth gauge\nserial_send_queue_depth %lld\n",
+             (unsigned long long)s.rxBytes, (unsigned long long)s.txBytes,
+             (unsigned long long)s.droppedBytes, (long long)s.sendQueueDepth);
+    std::string out = buffer;
+    AppendHistogramPrometheus(out, "read_to_event", s.readToEvent);
+    AppendHistogramPrometheus(out, "event_to_ui", s.eventToUi);
+    AppendHistogramPrometheus(out, "enqueue_to_write", s.enqueueToWrite);
+    AppendIntervalP99Prometheus(out, "read_to_event", s.readToEvent.Since(prev.readToEvent));
+    AppendIntervalP99Prometheus(out, "event_to_ui", s.eventToUi.Since(prev.eventToUi));
+    AppendIntervalP99Prometheus(out, "enqueue_to_write", s.enqueueToWrite.Since(prev.enqueueToWrite));
+    return out;
+}
+
+// 先写临时文件再改名，读取方不会看到写了一半的文件
+inline bool WriteMetricsFile(const std::string& path, const std::string& text) {
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) return false;
+    remove(path.c_str());   // Windows 上目标已存在时 rename 会失败
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,253 @@
+// port_discovery.h
+// 后台串口枚举：结果缓存，有变化时回调新增和移除的端口
+//
+// Windows 用 SetupDi 枚举，窗口收到 WM_DEVICECHANGE 时调用 Rescan()；
+// Linux 扫描 /dev/serial/by-id 和 ttyUSB/ttyACM 设备，并监听内核 uevent，
+// 适配器插拔后自动重新枚举。
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <setupapi.h>
+#include <initguid.h>
+
+#pragma comment(lib, "setupapi.lib")
+
+// 定义串口设备类 GUID
+// 这个 GUID 值来自 Microsoft 文档
+DEFINE_GUID(GUID_DEVCLASS_PORTS, 0x4D36E978, 0xE325, 0x11CE, 0xBF, 0xC1, 0x08, 0x00, 0x2B, 0xE1, 0x03, 0x18);
+#else
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+class PortDiscovery {
+public:
+    // initial 为 true 表示启动后第一次枚举的结果（已有的端口都在 added 里），没有端口时也会回调
+    typedef std::function<void(const std::vector<std::string>& added,
+                               const std::vector<std::string>& removed, bool initial)> ChangeHandler;
+
+    PortDiscovery() : thread(nullptr), running(false), rescan(false) {}
+    ~PortDiscovery() { Stop(); }
+
+    // 回调在枚举线程中执行
+    void SetChangeHandler(const ChangeHandler& h) { onChange = h; }
+
+    // 启动后立即在后台做第一次枚举
+    void Start() {
+        if (thread) return;
+        running = true;
+        rescan = true;
+        thread = new std::thread(&PortDiscovery::DiscoveryThread, this);
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_one();
+        if (thread) {
+            thread->join();
+            delete thread;
+            thread = nullptr;
+        }
+    }
+
+    // 请求重新枚举，立即返回
+    void Rescan() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            rescan = true;
+        }
+        condition.notify_one();
+    }
+
+    // 最近一次枚举的结果
+    std::vector<std::string> GetPorts() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return ports;
+    }
+
+private:
+    void DiscoveryThread() {
+#ifndef _WIN32
+        int uevent = OpenUevent();
+#endif
+        bool initial = true;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+#ifdef _WIN32
+                // 插拔由窗口消息触发；偶尔兜底扫描一次
+                condition.wait_for(lock, std::chrono::seconds(5), [this] { return rescan || !running; });
+                if (!running) break;
+#else
+                if (!running) break;
+#endif
+                rescan = false;
+            }
+
+            std::vector<std::string> found = Enumerate();
+            std::vector<std::string> added, removed;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::set_difference(found.begin(), found.end(), ports.begin(), ports.end(), std::back_inserter(added), PortLess);
+                std::set_difference(ports.begin(), ports.end(), found.begin(), found.end(), std::back_inserter(removed), PortLess);
+                ports = found;
+            }
+            if ((initial || !added.empty() || !removed.empty()) && onChange) onChange(added, removed, initial);
+            initial = false;
+
+#ifndef _WIN32
+            WaitForUevent(uevent);
+#endif
+        }
+#ifndef _WIN32
+        if (uevent >= 0) close(uevent);
+#endif
+    }
+
+#ifdef _WIN32
+    static std::vector<std::string> Enumerate() {
+        std::vector<std::string> result;
+        HDEVINFO hDevInfo = SetupDiGetClassDevs(&GUID_DEVCLASS_PORTS, NULL, NULL, DIGCF_PRESENT);
+        if (hDevInfo == INVALID_HANDLE_VALUE) return result;
+
+        SP_DEVINFO_DATA devInfoData;
+        devInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
+
+        for (DWORD i = 0; SetupDiEnumDeviceInfo(hDevInfo, i, &devInfoData); i++) {
+            // 从注册表获取实际的COM端口名
+            HKEY hKey = SetupDiOpenDevRegKey(hDevInfo, &devInfoData,
+                DICS_FLAG_GLOBAL, 0, DIREG_DEV, KEY_READ);
+            if (hKey == INVALID_HANDLE_VALUE) continue;
+
+            char portName[256];
+            DWORD portNameSize = sizeof(portName);
+            DWORD type;
+            if (RegQueryValueExA(hKey, "PortName", NULL, &type,
+                (LPBYTE)portName, &portNameSize) == ERROR_SUCCESS && type == REG_SZ) {
+                portName[sizeof(portName) - 1] = 0;
+                // 只添加COM端口
+                if (strncmp(portName, "COM", 3) == 0) {
+                    result.push_back(portName);
+                }
+            }
+            RegCloseKey(hKey);
+        }
+
+        SetupDiDestroyDeviceInfoList(hDevInfo);
+        std::sort(result.begin(), result.end(), PortLess);
+        return result;
+    }
+#else
+    static std::vector<std::string> Enumerate() {
+        std::set<std::string> nodes;
+
+        // by-id 下是指向实际设备的链接，解析后与 /dev 下扫到的去重
+        DIR* dir = opendir("/dev/serial/by-id");
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (entry->d_name[0] == '.') continue;
+                std::string link = std::string("/dev/serial/by-id/") + entry->d_name;
+                char target[PATH_MAX];
+                if (realpath(link.c_str(), target)) nodes.insert(target);
+            }
+            closedir(dir);
+        }
+
+        dir = opendir("/dev");
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (strncmp(entry->d_name, "ttyUSB", 6) == 0 || strncmp(entry->d_name, "ttyACM", 6) == 0) {
+                    nodes.insert(std::string("/dev/") + entry->d_name);
+                }
+            }
+            closedir(dir);
+        }
+
+        std::vector<std::string> result(nodes.begin(), nodes.end());
+        std::sort(result.begin(), result.end(), PortLess);
+        return result;
+    }
+
+    // 订阅内核设备事件，没有权限时返回 -1，退化为定时扫描
+    static int OpenUevent() {
+        int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (fd < 0) return -1;
+        struct sockaddr_nl addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = 1;
+        if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // 等到 tty 设备插拔、Rescan() 或停止；udev 建好 by-id 链接需要一点时间，收到事件后稍等再扫
+    void WaitForUevent(int fd) {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point fallback = Clock::now() + std::chrono::seconds(fd < 0 ? 2 : 30);
+        Clock::time_point due = Clock::time_point::max();
+        char buffer[4096];
+        while (running && !rescan) {
+            Clock::time_point now = Clock::now();
+            if (now >= due || now >= fallback) return;
+
+            if (fd < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 100) <= 0) continue;
+            ssize_t n = recv(fd, buffer, sizeof(buffer) - 1, 0);
+            if (n <= 0) continue;
+            // 消息是以 0 分隔的 KEY=VALUE 列表
+            buffer[n] = 0;
+            for (ssize_t i = 0; i < n; i += strlen(buffer + i) + 1) {
+                if (strcmp(buffer + i, "SUBSYSTEM=tty") == 0) {
+                    due = std::min(due, now + std::chrono::milliseconds(500));
+                    break;
+                }
+            }
+        }
+    }
+#endif
+
+    // COM2 排在 COM10 前面
+    static bool PortLess(const std::string& a, const std::string& b) {
+        if (a.size() != b.size()) return a.size() < b.size();
+        return a < b;
+    }
+
+    std::thread* thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<bool> running;
+    std::atomic<bool> rescan;
+    std::vector<std::string> ports;
+    ChangeHandler onChange;
+};
@@ -0,0 +1,69 @@
+// portscan.cpp
+// 串口枚举命令行工具：用和串口工具相同的 PortDiscovery 列出串口，
+// 可以持续打印插拔变化，用来在 Linux 上检查 /dev/serial/by-id 扫描和内核 uevent 监听。
+//
+// 用法：portscan [-w 秒数]
+//   不带参数时打印第一次枚举的结果后退出；-w 时继续等待并打印插拔，0 表示一直等到 Ctrl+C
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include "port_discovery.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void OnSignal(int) {
+    interrupted = 1;
+}
+
+int main(int argc, char** argv) {
+    double watchSeconds = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string opt = argv[i];
+        if (opt == "-w" && i + 1 < argc) {
+            watchSeconds = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: portscan [-w seconds]\n");
+            return 2;
+        }
+    }
+    signal(SIGINT, OnSignal);
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool listed = false;
+    PortDiscovery discovery;
+    discovery.SetChangeHandler([&](const std::vector<std::string>& added,
+                                   const std::vector<std::string>& removed, bool initial) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (initial) {
+            printf("%zu ports\n", added.size());
+            for (size_t i = 0; i < added.size(); i++) printf("  %s\n", added[i].c_str());
+        } else {
+            for (size_t i = 0; i < removed.size(); i++) printf("- %s\n", removed[i].c_str());
+            for (size_t i = 0; i < added.size(); i++) printf("+ %s\n", added[i].c_str());
+        }
+        fflush(stdout);
+        listed = true;
+        condition.notify_one();
+    });
+    discovery.Start();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!condition.wait_for(lock, std::chrono::seconds(5), [&] { return listed; })) {
+            fprintf(stderr, "Port enumeration timed out\n");
+            return 1;
+        }
+    }
+
+    if (watchSeconds >= 0) {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(static_cast<int64_t>(watchSeconds * 1000));
+        while (!interrupted && (watchSeconds == 0 || std::chrono::steady_clock::now() < end)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    discovery.Stop();
+    return 0;
+}
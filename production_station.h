@@ -0,0 +1,340 @@
+// production_station.h
+// 多端口生产工位：同时给多块电池烧录固件、校验并写入序列号
+//
+// 每个端口一个 BatteryLink，不各自开线程，而是由少量工作线程轮流
+// 调用 Poll() / Service()，几十个端口也只用固定数量的线程。
+// 这种模式下 BatteryLink 写串口不阻塞，写不出去的数据排队、超时算失败，
+// 一个卡住或拔掉的治具不会拖住同一工作线程上的其他端口。
+// 每个端口独立走 烧录 -> 校验 -> 写序列号 的流程，互不影响。
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "battery_link.h"
+#include "ota_transfer.h"
+
+enum StationState {
+    STATION_IDLE = 0,
+    STATION_CONNECTING,
+    STATION_FLASHING,
+    STATION_VERIFYING,
+    STATION_ASSIGNING_SN,
+    STATION_DONE,
+    STATION_FAILED
+};
+
+inline const char* StationStateName(int state) {
+    switch (state) {
+        case STATION_IDLE:          return "Idle";
+        case STATION_CONNECTING:    return "Connecting";
+        case STATION_FLASHING:      return "Flashing";
+        case STATION_VERIFYING:     return "Verifying";
+        case STATION_ASSIGNING_SN:  return "Assigning SN";
+        case STATION_DONE:          return "Done";
+        case STATION_FAILED:        return "Failed";
+        default:                    return "Unknown";
+    }
+}
+
+// 一个端口的当前状态，界面按固定节拍读取
+struct StationPortStatus {
+    std::string port;
+    int state;                  // StationState
+    int percent;                // 当前阶段进度
+    double bytesPerSecond;
+    std::string sn;
+    std::string message;
+};
+
+// 序列号分配，多个端口同时取号时保证不重复
+class SerialNumberAllocator {
+public:
+    SerialNumberAllocator() : autoIncrement(false) {}
+
+    void Reset(const std::string& first, bool autoInc) {
+        std::lock_guard<std::mutex> lock(mutex);
+        next = first;
+        autoIncrement = autoInc;
+    }
+
+    // 取一个号；没有开启自增时不分配（多块电池不能写同一个序列号）
+    bool Allocate(std::string& sn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!autoIncrement || next.empty()) return false;
+        sn = next;
+        next = IncrementSerialNumber(next);
+        return true;
+    }
+
+    std::string GetNext() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return next;
+    }
+
+private:
+    std::mutex mutex;
+    std::string next;
+    bool autoIncrement;
+};
+
+// 工位上的一个端口及其流程状态
+class StationPort {
+public:
+    explicit StationPort(const std::string& name)
+        : flashJob(nullptr), verifyJob(nullptr), serialNumbers(nullptr), stopping(false) {
+        status.port = name;
+        status.state = STATION_IDLE;
+        status.percent = 0;
+        status.bytesPerSecond = 0;
+    }
+
+    ~StationPort() { Close(); }
+
+    bool Open(int baud, FrameMode mode) {
+        SetState(STATION_CONNECTING, "");
+        std::string error;
+        if (mode == FRAME_TEXT) {
+            SetState(STATION_FAILED, "Station needs a binary framing mode");
+            return false;
+        }
+        link.SetErrorHandler([this](const std::string& message) {
+            if (!stopping) SetState(STATION_FAILED, message);
+        });
+        if (!link.Open(status.port, baud, mode, error, false)) {
+            SetState(STATION_FAILED, error);
+            return false;
+        }
+        return true;
+    }
+
+    // 开始烧录流程；两个任务都在这里创建，之后由工作线程驱动
+    void Run(const std::vector<uint8_t>& image, uint32_t baseAddress, SerialNumberAllocator* sns) {
+        serialNumbers = sns;
+
+        flashJob = new FlashDiffUpdate(link.GetEngine(), image, baseAddress);
+        flashJob->SetBaudRate(link.GetBaudRate());
+        flashJob->SetProgressHandler([this](const OtaProgress& p) { OnProgress(p); });
+        flashJob->SetDoneHandler([this](bool ok, const std::string& message) { OnFlashDone(ok, message); });
+
+        verifyJob = new FlashDiffUpdate(link.GetEngine(), image, baseAddress);
+        verifyJob->SetVerifyOnly(true);
+        verifyJob->SetBaudRate(link.GetBaudRate());
+        verifyJob->SetDoneHandler([this](bool ok, const std::string& message) { OnVerifyDone(ok, message); });
+
+        SetState(STATION_FLASHING, "");
+        flashJob->Start();
+    }
+
+    // 工作线程调用
+    size_t Poll() { return link.Poll(); }
+    void Service() { link.Service(); }
+
+    // 先关闭连接（未完成的命令会被取消），再释放任务；保留最后的状态供界面显示
+    void Close() {
+        if (IsActive()) SetState(STATION_FAILED, "Stopped");
+        stopping = true;
+        link.Close();
+        delete flashJob;
+        delete verifyJob;
+        flashJob = nullptr;
+        verifyJob = nullptr;
+    }
+
+    StationPortStatus GetStatus() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return status;
+    }
+
+    bool IsActive() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return status.state != STATION_IDLE && status.state != STATION_DONE && status.state != STATION_FAILED;
+    }
+
+private:
+    void SetState(int state, const std::string& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 已经失败的端口不再被后续回调改写状态
+        if (status.state == STATION_FAILED && state != STATION_CONNECTING) return;
+        status.state = state;
+        status.message = message;
+        status.percent = state == STATION_DONE ? 100 : 0;
+        if (state != STATION_FLASHING) status.bytesPerSecond = 0;
+    }
+
+    void OnProgress(const OtaProgress& p) {
+        std::lock_guard<std::mutex> lock(mutex);
+        status.percent = p.total > 0 ? static_cast<int>(p.bytesDone * 100 / p.total) : 0;
+        status.bytesPerSecond = p.bytesPerSecond;
+    }
+
+    void OnFlashDone(bool ok, const std::string& message) {
+        if (stopping) return;
+        if (!ok) {
+            SetState(STATION_FAILED, message);
+            return;
+        }
+        // 写入后再单独做一遍只读校验
+        SetState(STATION_VERIFYING, message);
+        verifyJob->Start();
+    }
+
+    void OnVerifyDone(bool ok, const std::string& message) {
+        if (stopping) return;
+        if (!ok) {
+            SetState(STATION_FAILED, message);
+            return;
+        }
+
+        std::string sn;
+        if (!serialNumbers || !serialNumbers->Allocate(sn)) {
+            SetState(STATION_DONE, message);
+            return;
+        }
+        SetState(STATION_ASSIGNING_SN, "");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            status.sn = sn;
+        }
+        std::vector<uint8_t> payload;
+        BuildSerialNumber(sn, payload);
+        link.GetEngine()->Submit(CMD_SET_SN, payload, [this](const CommandResult& r) {
+            if (stopping) return;
+            if (r.status == CMD_STATUS_OK) {
+                SetState(STATION_DONE, "Flash verified, SN written");
+            } else {
+                SetState(STATION_FAILED, std::string("Set SN ") + CommandStatusName(r.status));
+            }
+        });
+    }
+
+    BatteryLink link;
+    FlashDiffUpdate* flashJob;
+    FlashDiffUpdate* verifyJob;
+    SerialNumberAllocator* serialNumbers;
+    std::atomic<bool> stopping;
+
+    std::mutex mutex;
+    StationPortStatus status;
+};
+
+class ProductionStation {
+public:
+    // workerCount 个工作线程平分所有端口
+    explicit ProductionStation(size_t workerCount = 4)
+        : workerCount(workerCount < 1 ? 1 : workerCount), baseAddress(0), running(false) {}
+
+    ~ProductionStation() {
+        Stop();
+        Clear();
+    }
+
+    void SetImage(const std::vector<uint8_t>& data, uint32_t base) {
+        image = data;
+        baseAddress = base;
+    }
+
+    void SetSerialNumbers(const std::string& first, bool autoIncrement) {
+        serialNumbers.Reset(first, autoIncrement);
+    }
+
+    // 打开所有端口并开始烧录；打不开的端口直接标记失败，不影响其他端口
+    void Start(const std::vector<std::string>& portNames, int baud, FrameMode mode) {
+        Stop();
+        Clear();
+        std::vector<bool> opened;
+        for (size_t i = 0; i < portNames.size(); i++) {
+            ports.push_back(new StationPort(portNames[i]));
+            opened.push_back(ports.back()->Open(baud, mode));
+        }
+
+        // 端口全部打开后再启动工作线程，之后端口列表不再变化
+        running = true;
+        size_t count = workerCount < ports.size() ? workerCount : ports.size();
+        for (size_t i = 0; i < count; i++) {
+            workers.push_back(new std::thread(&ProductionStation::Worker, this, i, count));
+        }
+
+        for (size_t i = 0; i < ports.size(); i++) {
+            if (opened[i]) ports[i]->Run(image, baseAddress, &serialNumbers);
+        }
+    }
+
+    // 先停工作线程，再关闭各端口
+    void Stop() {
+        running = false;
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->join();
+            delete workers[i];
+        }
+        workers.clear();
+        for (size_t i = 0; i < ports.size(); i++) {
+            ports[i]->Close();
+        }
+    }
+
+    std::vector<StationPortStatus> GetStatus() {
+        std::vector<StationPortStatus> result;
+        for (size_t i = 0; i < ports.size(); i++) {
+            result.push_back(ports[i]->GetStatus());
+        }
+        return result;
+    }
+
+    // 还有端口没有结束流程
+    bool IsBusy() {
+        for (size_t i = 0; i < ports.size(); i++) {
+            if (ports[i]->IsActive()) return true;
+        }
+        return false;
+    }
+
+    std::string GetNextSerialNumber() { return serialNumbers.GetNext(); }
+
+private:
+    void Clear() {
+        for (size_t i = 0; i < ports.size(); i++) {
+            delete ports[i];
+        }
+        ports.clear();
+    }
+
+    // 工作线程 index 负责第 index, index+stride, ... 个端口
+    void Worker(size_t index, size_t stride) {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point nextService = Clock::now();
+        while (running) {
+            size_t bytes = 0;
+            for (size_t i = index; i < ports.size(); i += stride) {
+                bytes += ports[i]->Poll();
+            }
+
+            // 命令超时检查不需要每次都做，5ms 一次足够
+            Clock::time_point now = Clock::now();
+            if (now >= nextService) {
+                for (size_t i = index; i < ports.size(); i += stride) {
+                    ports[i]->Service();
+                }
+                nextService = now + std::chrono::milliseconds(5);
+            }
+
+            // 所有端口都没有数据时才休眠
+            if (bytes == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    size_t workerCount;
+    std::vector<uint8_t> image;
+    uint32_t baseAddress;
+    SerialNumberAllocator serialNumbers;
+
+    std::vector<StationPort*> ports;
+    std::vector<std::thread*> workers;
+    std::atomic<bool> running;
+};
@@ -0,0 +1,268 @@
+// serial_port.h
+// 串口读写封装：Windows 用 Win32 API，其他平台用 termios
+// 读为非阻塞（没有数据立即返回 0），写会一直写到全部完成或出错
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#endif
+
+class SerialPort {
+public:
+    SerialPort() {
+#ifdef _WIN32
+        handle = INVALID_HANDLE_VALUE;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~SerialPort() { Close(); }
+
+#ifdef _WIN32
+    bool Open(const std::string& portName, int baudRate, std::string& error) {
+        Close();
+        // 确保端口名称格式正确（如果用户只输入了 "COM3"，需要加上完整路径）
+        std::string fullPortName = portName;
+        if (fullPortName.compare(0, 4, "\\\\.\\") != 0) {
+            fullPortName = "\\\\.\\" + portName;
+        }
+
+        handle = CreateFileA(fullPortName.c_str(),
+                             GENERIC_READ | GENERIC_WRITE,
+                             0,
+                             0,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             0);
+        if (handle == INVALID_HANDLE_VALUE) {
+            error = "Failed to open serial port: " + fullPortName +
+                    "\nError code: " + std::to_string(GetLastError());
+            return false;
+        }
+
+        if (!SetBaudRate(baudRate)) {
+            Close();
+            error = "Error setting serial port state";
+            return false;
+        }
+
+        // 设置缓冲区大小
+        if (!SetupComm(handle, 4096, 4096)) {
+            Close();
+            error = "Error setting serial port buffers";
+            return false;
+        }
+
+        // 读立即返回；写超时很短，由 Write 循环写完
+        COMMTIMEOUTS timeouts = {0};
+        timeouts.ReadIntervalTimeout = MAXDWORD;
+        timeouts.ReadTotalTimeoutConstant = 0;
+        timeouts.ReadTotalTimeoutMultiplier = 0;
+        timeouts.WriteTotalTimeoutConstant = 1;
+        timeouts.WriteTotalTimeoutMultiplier = 0;
+        if (!SetCommTimeouts(handle, &timeouts)) {
+            Close();
+            error = "Error setting serial port timeouts";
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    bool IsOpen() const { return handle != INVALID_HANDLE_VALUE; }
+
+    // SetCommState 立即生效，先等已写出的数据按原速率发完，否则会被改坏
+    bool SetBaudRate(int baudRate) {
+        DCB dcbSerialParams = {0};
+        dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+        if (!GetCommState(handle, &dcbSerialParams)) return false;
+        DrainOutput(dcbSerialParams.BaudRate);
+
+        dcbSerialParams.BaudRate = baudRate;
+        dcbSerialParams.ByteSize = 8;
+        dcbSerialParams.StopBits = ONESTOPBIT;
+        dcbSerialParams.Parity = NOPARITY;
+
+        // 优化串口设置
+        dcbSerialParams.fBinary = TRUE;
+        dcbSerialParams.fDtrControl = DTR_CONTROL_ENABLE;
+        dcbSerialParams.fRtsControl = RTS_CONTROL_ENABLE;
+        dcbSerialParams.fOutxCtsFlow = FALSE;
+        dcbSerialParams.fOutxDsrFlow = FALSE;
+        dcbSerialParams.fDsrSensitivity = FALSE;
+        dcbSerialParams.fAbortOnError = FALSE;
+        return SetCommState(handle, &dcbSerialParams) != 0;
+    }
+
+    // 等驱动的发送队列清空（最多约 1 秒），再等 UART 硬件 FIFO（按 64 字节算）发完
+    void DrainOutput(DWORD baudRate) {
+        for (int i = 0; i < 1000; i++) {
+            DWORD errors = 0;
+            COMSTAT stat = {0};
+            if (!ClearCommError(handle, &errors, &stat) || stat.cbOutQue == 0) break;
+            Sleep(1);
+        }
+        if (baudRate > 0) Sleep(64 * 10 * 1000 / baudRate + 1);
+    }
+
+    // 返回读到的字节数，没有数据返回 0，出错（如设备拔出）返回 -1
+    int Read(uint8_t* buffer, size_t size) {
+        DWORD bytesRead = 0;
+        if (!ReadFile(handle, buffer, static_cast<DWORD>(size), &bytesRead, NULL)) return -1;
+        return static_cast<int>(bytesRead);
+    }
+
+    bool Write(const uint8_t* data, size_t length) {
+        size_t sent = 0;
+        int stalls = 0;
+        while (sent < length) {
+            DWORD bytesWritten = 0;
+            if (!WriteFile(handle, data + sent, static_cast<DWORD>(length - sent), &bytesWritten, NULL)) {
+                return false;
+            }
+            // 每次写超时 1ms，连续约 1 秒写不出去认为对端已停止接收
+            if (bytesWritten == 0 && ++stalls > 1000) return false;
+            if (bytesWritten > 0) stalls = 0;
+            sent += bytesWritten;
+        }
+        return true;
+    }
+
+    // 写一次，不等待（最多等 1ms 的写超时）；返回写出的字节数，出错返回 -1
+    int WriteSome(const uint8_t* data, size_t length) {
+        DWORD bytesWritten = 0;
+        if (!WriteFile(handle, data, static_cast<DWORD>(length), &bytesWritten, NULL)) return -1;
+        return static_cast<int>(bytesWritten);
+    }
+
+    // 丢弃收发缓冲区里的残留数据
+    void Purge() {
+        PurgeComm(handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+    }
+
+private:
+    HANDLE handle;
+#else
+    bool Open(const std::string& portName, int baudRate, std::string& error) {
+        Close();
+        fd = open(portName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0) {
+            error = "Failed to open serial port: " + portName + "\nError: " + strerror(errno);
+            return false;
+        }
+
+        struct termios tio;
+        if (tcgetattr(fd, &tio) != 0) {
+            error = std::string("Error getting serial port state: ") + strerror(errno);
+            Close();
+            return false;
+        }
+        // 8N1，原始模式，不做任何字符处理
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~CRTSCTS;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        if (tcsetattr(fd, TCSANOW, &tio) != 0 || !SetBaudRate(baudRate)) {
+            error = "Error setting serial port state";
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    bool IsOpen() const { return fd >= 0; }
+
+    bool SetBaudRate(int baudRate) {
+        speed_t speed = ToSpeed(baudRate);
+        if (speed == 0) return false;
+        struct termios tio;
+        if (tcgetattr(fd, &tio) != 0) return false;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        return tcsetattr(fd, TCSADRAIN, &tio) == 0;
+    }
+
+    int Read(uint8_t* buffer, size_t size) {
+        ssize_t n = read(fd, buffer, size);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        return static_cast<int>(n);
+    }
+
+    bool Write(const uint8_t* data, size_t length) {
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t n = write(fd, data + sent, length - sent);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+                // 输出缓冲区满，等到可写
+                struct pollfd pfd = { fd, POLLOUT, 0 };
+                if (poll(&pfd, 1, 1000) <= 0) return false;
+                continue;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    // 写一次，不等待；输出缓冲区满时返回 0，出错返回 -1
+    int WriteSome(const uint8_t* data, size_t length) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        return static_cast<int>(n);
+    }
+
+    void Purge() {
+        tcflush(fd, TCIOFLUSH);
+    }
+
+private:
+    static speed_t ToSpeed(int baudRate) {
+        switch (baudRate) {
+            case 9600:    return B9600;
+            case 19200:   return B19200;
+            case 38400:   return B38400;
+            case 57600:   return B57600;
+            case 115200:  return B115200;
+            case 230400:  return B230400;
+            case 460800:  return B460800;
+            case 921600:  return B921600;
+#ifdef B1000000
+            case 1000000: return B1000000;
+            case 1500000: return B1500000;
+            case 2000000: return B2000000;
+            case 3000000: return B3000000;
+#endif
+            default:      return 0;
+        }
+    }
+
+    int fd;
+#endif
+};
@@ -0,0 +1,243 @@
+// telemetry_series.h
+// 遥测曲线数据：按列存储的时间序列 + 多级 min/max 金字塔
+//
+// 每 4 个原始点合成上一级的一个 {min, max}，再往上每级再 4 合 1。
+// 画图时按可见范围内的点数选一级，使实际遍历的点数与屏幕列数相当，
+// 几小时 1kHz 的数据缩放平移时也只处理几千个点。
+//
+// 数据按固定大小的块存储，追加时不会整体搬移；超过保留点数后按块丢弃最旧的数据。
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+#include "battery_protocol.h"
+
+enum SeriesChannel {
+    SERIES_VOLTAGE = 0,     // V
+    SERIES_CURRENT,         // A
+    SERIES_TEMPERATURE,     // °C
+    SERIES_CHANNELS
+};
+
+struct MinMax {
+    float min;
+    float max;
+};
+
+// 分块的序列：每块预留 CHUNK 个元素，写满再开新块，已有元素不会被搬移。
+// 下标是从第一次追加起的序号，丢弃前面的块后不变，有效范围为 [Begin(), End())
+template <typename T>
+class ChunkedSeries {
+public:
+    static const size_t CHUNK = 4096;
+
+    ChunkedSeries() : first(0), last(0) {}
+
+    void PushBack(const T& value) {
+        if (chunks.empty() || chunks.back().size() == CHUNK) {
+            chunks.push_back(std::vector<T>());
+            chunks.back().reserve(CHUNK);
+        }
+        chunks.back().push_back(value);
+        last++;
+    }
+
+    // 丢弃完全位于 index 之前的块，最后一块总是保留
+    void DropBefore(size_t index) {
+        while (chunks.size() > 1 && first + CHUNK <= index) {
+            chunks.pop_front();
+            first += CHUNK;
+        }
+    }
+
+    void Clear() {
+        chunks.clear();
+        first = last = 0;
+    }
+
+    // 块按 CHUNK 对齐，first 总是 CHUNK 的整数倍
+    T& operator[](size_t i) { return chunks[(i - first) / CHUNK][i % CHUNK]; }
+    const T& operator[](size_t i) const { return chunks[(i - first) / CHUNK][i % CHUNK]; }
+    const T& Back() const { return chunks.back().back(); }
+
+    size_t Begin() const { return first; }
+    size_t End() const { return last; }
+    bool Empty() const { return first == last; }
+
+private:
+    std::deque<std::vector<T> > chunks;
+    size_t first;
+    size_t last;
+};
+
+class TelemetrySeries {
+public:
+    static const size_t LEVEL_FACTOR = 4;
+    // 默认保留约 100 万个点（1kHz 约 17 分钟，10Hz 一天以上）。每点约 28 字节：
+    // 时间 8 + 三个通道各 4，金字塔每通道 1/4 + 1/16 + ... ≈ 1/3 个 8 字节的桶，共约 28MB
+    static const size_t DEFAULT_RETENTION = 1024 * 1024;
+
+    TelemetrySeries() : retention(DEFAULT_RETENTION) {}
+
+    // 最多保留的原始点数，超出后按块丢弃最旧的点和对应的桶
+    void SetRetention(size_t points) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retention = points < ChunkedSeries<double>::CHUNK ? ChunkedSeries<double>::CHUNK : points;
+    }
+
+    // 接收线程调用，t 为秒
+    void Append(double t, const TelemetryRecord& rec) {
+        float v[SERIES_CHANNELS];
+        v[SERIES_VOLTAGE] = rec.voltage / 1000.0f;
+        v[SERIES_CURRENT] = rec.current / 1000.0f;
+        v[SERIES_TEMPERATURE] = rec.temperature / 10.0f;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // 时间必须单调，乱序的点丢弃
+        if (!times.Empty() && t < times.Back()) return;
+        times.PushBack(t);
+        size_t n = times.End();
+        for (int c = 0; c < SERIES_CHANNELS; c++) {
+            values[c].PushBack(v[c]);
+            // 逐级并入当前桶，桶满后开新桶；点数超过 4^k 时才需要第 k 级
+            size_t bucket = LEVEL_FACTOR;
+            for (size_t k = 0; n > bucket / LEVEL_FACTOR; k++, bucket *= LEVEL_FACTOR) {
+                if (k == levels[c].size()) {
+                    // 新开一级：保留的点都落在第一个桶里，由下一级合并得到
+                    MinMax m = { v[c], v[c] };
+                    if (k == 0) {
+                        for (size_t i = values[c].Begin(); i < n; i++) Fold(m, values[c][i], values[c][i]);
+                    } else {
+                        const ChunkedSeries<MinMax>& lower = levels[c][k - 1];
+                        for (size_t i = lower.Begin(); i < lower.End(); i++) Fold(m, lower[i].min, lower[i].max);
+                    }
+                    levels[c].push_back(ChunkedSeries<MinMax>());
+                    levels[c].back().PushBack(m);
+                    continue;
+                }
+                ChunkedSeries<MinMax>& level = levels[c][k];
+                size_t index = (n - 1) / bucket;
+                if (index == level.End()) {
+                    MinMax m = { v[c], v[c] };
+                    level.PushBack(m);
+                } else {
+                    Fold(level[index], v[c], v[c]);
+                }
+            }
+        }
+
+        if (n - times.Begin() > retention) {
+            // 跨过丢弃边界的桶还保留着，其中包含已丢弃点的 min/max，只影响最左边一个桶
+            size_t start = n - retention;
+            times.DropBefore(start);
+            for (int c = 0; c < SERIES_CHANNELS; c++) {
+                values[c].DropBefore(start);
+                size_t bucket = LEVEL_FACTOR;
+                for (size_t k = 0; k < levels[c].size(); k++, bucket *= LEVEL_FACTOR) {
+                    levels[c][k].DropBefore(start / bucket);
+                }
+            }
+        }
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        times.Clear();
+        for (int c = 0; c < SERIES_CHANNELS; c++) {
+            values[c].Clear();
+            levels[c].clear();
+        }
+    }
+
+    size_t GetCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return times.End() - times.Begin();
+    }
+
+    // 数据的时间范围，没有数据返回 false
+    bool GetRange(double& first, double& last) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (times.Empty()) return false;
+        first = times[times.Begin()];
+        last = times.Back();
+        return true;
+    }
+
+    // 把 [t0, t1] 内的数据归并到 columns 列，每列一个 {min, max}；没有数据的列 min > max
+    // 返回实际遍历的点（或桶）数
+    size_t Query(int channel, double t0, double t1, size_t columns, std::vector<MinMax>& out) {
+        MinMax empty = { std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+        out.assign(columns, empty);
+        if (columns == 0 || t1 <= t0) return 0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t i0 = Find(t0, false);
+        size_t i1 = Find(t1, true);
+        if (i0 >= i1) return 0;
+
+        // 选最粗的一级，但保证每列至少还有一个桶
+        size_t count = i1 - i0;
+        size_t bucket = 1;
+        size_t level = 0;
+        while (level < levels[channel].size() && count / (bucket * LEVEL_FACTOR) >= columns) {
+            bucket *= LEVEL_FACTOR;
+            level++;
+        }
+
+        double scale = columns / (t1 - t0);
+        size_t visited = 0;
+        if (bucket == 1) {
+            const ChunkedSeries<float>& v = values[channel];
+            for (size_t i = i0; i < i1; i++) {
+                Fold(out[Column(times[i], t0, scale, columns)], v[i], v[i]);
+            }
+            visited = count;
+        } else {
+            // 桶的时间取桶内第一个保留的点，边缘最多差一个桶
+            const ChunkedSeries<MinMax>& v = levels[channel][level - 1];
+            size_t b = std::max(i0 / bucket, v.Begin());
+            for (; b <= (i1 - 1) / bucket && b < v.End(); b++) {
+                size_t i = std::max(b * bucket, times.Begin());
+                Fold(out[Column(times[i], t0, scale, columns)], v[b].min, v[b].max);
+                visited++;
+            }
+        }
+        return visited;
+    }
+
+private:
+    // 持锁调用：times 中第一个不小于 t（upper 为 true 时大于 t）的下标
+    size_t Find(double t, bool upper) {
+        size_t lo = times.Begin(), hi = times.End();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (upper ? times[mid] <= t : times[mid] < t) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    static size_t Column(double t, double t0, double scale, size_t columns) {
+        double x = (t - t0) * scale;
+        if (x < 0) return 0;
+        size_t column = static_cast<size_t>(x);
+        return column >= columns ? columns - 1 : column;
+    }
+
+    static void Fold(MinMax& m, float lo, float hi) {
+        if (lo < m.min) m.min = lo;
+        if (hi > m.max) m.max = hi;
+    }
+
+    std::mutex mutex;
+    size_t retention;
+    ChunkedSeries<double> times;
+    ChunkedSeries<float> values[SERIES_CHANNELS];
+    // levels[c][k] 的每个桶覆盖 4^(k+1) 个原始点，第 b 个桶对应原始点 [b*4^(k+1), (b+1)*4^(k+1))
+    std::vector<ChunkedSeries<MinMax> > levels[SERIES_CHANNELS];
+};
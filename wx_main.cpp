@@ -1,32 +1,526 @@
 // main.cpp
 #include <wx/wx.h>
 #include <wx/notebook.h>
+#include <wx/timer.h>
+#include <wx/filedlg.h>
+#include <wx/gauge.h>
+#include <wx/listctrl.h>
+#include <wx/dcbuffer.h>
 #include <windows.h>
-#include <setupapi.h>
-#include <initguid.h>
 #include <thread>
 #include <atomic>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
+#include <fstream>
+#include "frame_codec.h"
+#include "battery_telemetry.h"
+#include "command_engine.h"
+#include "ota_transfer.h"
+#include "battery_link.h"
+#include "production_station.h"
+#include "port_discovery.h"
+#include "pipeline_metrics.h"
+#include "log_index.h"
+#include "hex_dump.h"
+#include "baud_negotiator.h"
 
-#pragma comment(lib, "setupapi.lib")
+// 电池面板刷新间隔（毫秒），设备上报再快界面也只按这个节拍更新
+static const int TELEMETRY_REFRESH_MS = 100;
 
-// 定义串口设备类 GUID
-// 这个 GUID 值来自 Microsoft 文档
-DEFINE_GUID(GUID_DEVCLASS_PORTS, 0x4D36E978, 0xE325, 0x11CE, 0xBF, 0xC1, 0x08, 0x00, 0x2B, 0xE1, 0x03, 0x18);
+// 状态栏指标刷新和导出间隔（毫秒）
+static const int METRICS_REFRESH_MS = 1000;
+
+// 日志框最多显示的行数，更早的行只在索引里，可以用过滤查找
+static const size_t LOG_VIEW_LINES = 10000;
+// 日志框超出 LOG_VIEW_LINES 这么多行时一次删掉最早的，不用每次追加都删
+static const size_t LOG_TRIM_LINES = 1000;
+
+// 过滤条件停止输入多久后才开始查找（毫秒）
+static const int FILTER_DELAY_MS = 250;
+
+// 解帧后投递给界面线程的一帧
+struct FramePacket {
+    uint8_t type;
+    uint8_t seq;
+    std::vector<uint8_t> data;
+    int64_t queued;     // 投递时间（MetricsNow）
+};
+
+// 查找线程投递给界面线程的过滤结果
+struct LogSearchResult {
+    uint32_t generation;        // 请求序号，不是最新请求的结果直接丢弃
+    LogMatcher matcher;
+    std::vector<uint32_t> rows;
+    size_t lines;               // 查找时索引里的行数，之后追加的行由界面线程补查
+    size_t compared;
+    double ms;
+};
+
+// 发送队列中的一条数据
+struct SendItem {
+    wxString data;
+    int64_t queued;     // 入队时间（MetricsNow）
+};
+
+// 速率协商或恢复的结果，投递给界面线程
+struct LinkSpeedChange {
+    bool restore;       // true 为传输结束后的恢复，false 为传输前的提速
+    bool ok;
+    int baud;
+    std::string message;
+    uint32_t generation;    // 协商开始时的 linkGeneration
+};
+
+// 端口枚举线程投递给界面线程的变化
+struct PortChange {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    bool initial;       // 启动后第一次枚举，已有的端口不算新增
+};
+
+// 遥测曲线：电压、电流、温度三条上下排列，共用时间轴
+// 滚轮缩放，左键拖动平移，双击回到跟随最新数据
+class PlotPanel : public wxPanel {
+public:
+    PlotPanel(wxWindow* parent, TelemetrySeries* series)
+        : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE),
+          series(series), follow(true), viewEnd(0), viewSpan(60), dragging(false), dragX(0), dragEnd(0) {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        Bind(wxEVT_PAINT, &PlotPanel::OnPaint, this);
+        Bind(wxEVT_MOUSEWHEEL, &PlotPanel::OnWheel, this);
+        Bind(wxEVT_LEFT_DOWN, &PlotPanel::OnLeftDown, this);
+        Bind(wxEVT_LEFT_UP, &PlotPanel::OnLeftUp, this);
+        Bind(wxEVT_MOTION, &PlotPanel::OnMotion, this);
+        Bind(wxEVT_LEFT_DCLICK, &PlotPanel::OnDoubleClick, this);
+        Bind(wxEVT_MOUSE_CAPTURE_LOST, &PlotPanel::OnCaptureLost, this);
+    }
+
+    // 跟随最新数据时由定时器调用
+    bool IsFollowing() const { return follow; }
+
+private:
+    static const int LEFT_MARGIN = 60;
+
+    void OnPaint(wxPaintEvent& event) {
+        wxAutoBufferedPaintDC dc(this);
+        dc.SetBackground(*wxWHITE_BRUSH);
+        dc.Clear();
+
+        wxSize size = GetClientSize();
+        int left = FromDIP(LEFT_MARGIN);
+        int width = size.GetWidth() - left;
+        int stripHeight = size.GetHeight() / SERIES_CHANNELS;
+        if (width <= 0 || stripHeight <= 0) return;
+
+        double first, last;
+        if (!series->GetRange(first, last)) {
+            dc.DrawText("No telemetry", left + FromDIP(5), FromDIP(5));
+            return;
+        }
+        if (follow) viewEnd = last;
+        double t0 = viewEnd - viewSpan;
+
+        static const char* names[SERIES_CHANNELS] = { "Voltage (V)", "Current (A)", "Temp (C)" };
+        static const wxColour colours[SERIES_CHANNELS] = {
+            wxColour(0, 90, 200), wxColour(200, 60, 0), wxColour(0, 140, 60)
+        };
+
+        std::vector<MinMax> columns;
+        for (int c = 0; c < SERIES_CHANNELS; c++) {
+            int top = c * stripHeight;
+            int bottom = top + stripHeight - 1;
+            series->Query(c, t0, viewEnd, width, columns);
+
+            // 纵轴按可见数据自动缩放
+            float lo = std::numeric_limits<float>::max(), hi = -std::numeric_limits<float>::max();
+            for (size_t x = 0; x < columns.size(); x++) {
+                if (columns[x].min > columns[x].max) continue;
+                lo = std::min(lo, columns[x].min);
+                hi = std::max(hi, columns[x].max);
+            }
+
+            dc.SetPen(*wxLIGHT_GREY_PEN);
+            dc.DrawLine(left, bottom, size.GetWidth(), bottom);
+            dc.SetTextForeground(colours[c]);
+            dc.DrawText(names[c], left + FromDIP(5), top + FromDIP(2));
+            if (lo > hi) continue;
+
+            float pad = (hi - lo) * 0.05f + 0.001f;
+            lo -= pad;
+            hi += pad;
+            double scale = (stripHeight - FromDIP(4)) / (hi - lo);
+            dc.SetTextForeground(*wxBLACK);
+            dc.DrawText(wxString::Format("%.3f", hi), FromDIP(2), top + FromDIP(2));
+            dc.DrawText(wxString::Format("%.3f", lo), FromDIP(2), bottom - FromDIP(16));
+
+            // 每列画一条 min-max 竖线，相邻列之间连线
+            dc.SetPen(wxPen(colours[c]));
+            int prevX = -1, prevY = 0;
+            for (size_t x = 0; x < columns.size(); x++) {
+                if (columns[x].min > columns[x].max) continue;
+                int px = left + static_cast<int>(x);
+                int yMax = bottom - FromDIP(2) - static_cast<int>((columns[x].max - lo) * scale);
+                int yMin = bottom - FromDIP(2) - static_cast<int>((columns[x].min - lo) * scale);
+                dc.DrawLine(px, yMax, px, yMin + 1);
+                int y = (yMax + yMin) / 2;
+                if (prevX >= 0) dc.DrawLine(prevX, prevY, px, y);
+                prevX = px;
+                prevY = y;
+            }
+        }
+
+        dc.SetTextForeground(*wxBLACK);
+        dc.DrawText(wxString::Format("%.1f s - %.1f s%s", t0, viewEnd, follow ? " (live)" : ""),
+                    left + FromDIP(5), size.GetHeight() - FromDIP(18));
+    }
+
+    // 以鼠标所在时间为中心缩放
+    void OnWheel(wxMouseEvent& event) {
+        int left = FromDIP(LEFT_MARGIN);
+        int width = GetClientSize().GetWidth() - left;
+        if (width <= 0) return;
+
+        double factor = event.GetWheelRotation() > 0 ? 0.8 : 1.25;
+        double span = std::max(0.01, std::min(viewSpan * factor, 7 * 24 * 3600.0));
+        if (!follow) {
+            double pos = std::max(0.0, std::min(1.0, double(event.GetX() - left) / width));
+            double at = viewEnd - viewSpan * (1 - pos);
+            viewEnd = at + span * (1 - pos);
+        }
+        viewSpan = span;
+        Refresh();
+    }
+
+    void OnLeftDown(wxMouseEvent& event) {
+        dragging = true;
+        dragX = event.GetX();
+        dragEnd = viewEnd;
+        CaptureMouse();
+    }
+
+    void OnLeftUp(wxMouseEvent& event) {
+        if (!dragging) return;
+        dragging = false;
+        if (HasCapture()) ReleaseMouse();
+    }
+
+    void OnMotion(wxMouseEvent& event) {
+        if (!dragging) return;
+        int width = GetClientSize().GetWidth() - FromDIP(LEFT_MARGIN);
+        if (width <= 0) return;
+        int dx = event.GetX() - dragX;
+        if (dx == 0) return;
+        follow = false;
+        viewEnd = dragEnd - dx * viewSpan / width;
+        Refresh();
+    }
+
+    void OnDoubleClick(wxMouseEvent& event) {
+        follow = true;
+        Refresh();
+    }
+
+    void OnCaptureLost(wxMouseCaptureLostEvent& event) {
+        dragging = false;
+    }
+
+    TelemetrySeries* series;
+    bool follow;
+    double viewEnd;         // 可见范围的结束时间（秒）
+    double viewSpan;        // 可见范围的长度（秒）
+    bool dragging;
+    int dragX;
+    double dragEnd;
+};
+
+// 原始收发字节的十六进制视图，只格式化窗口里能看到的那几十行
+// 滚轮翻页，双击回到跟随最新数据；发送的行用蓝色显示
+class HexView : public wxPanel {
+public:
+    HexView(wxWindow* parent, HexDumpStore* store)
+        : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE),
+          store(store), follow(true), topRow(0), shownVersion(0),
+          font(9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL) {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        font = font.Scale(GetContentScaleFactor());
+        Bind(wxEVT_PAINT, &HexView::OnPaint, this);
+        Bind(wxEVT_MOUSEWHEEL, &HexView::OnWheel, this);
+        Bind(wxEVT_LEFT_DCLICK, &HexView::OnDoubleClick, this);
+    }
+
+    // 定时器据此判断是否需要重画：跟随最新数据且有新数据时
+    bool NeedsRefresh() const { return follow && store->GetVersion() != shownVersion; }
+
+private:
+    void OnPaint(wxPaintEvent& event) {
+        wxAutoBufferedPaintDC dc(this);
+        dc.SetBackground(*wxWHITE_BRUSH);
+        dc.Clear();
+        dc.SetFont(font);
+        shownVersion = store->GetVersion();
+
+        int charWidth, lineHeight;
+        dc.GetTextExtent("0", &charWidth, &lineHeight);
+        if (lineHeight <= 0) return;
+        int left = FromDIP(4);
+        // 最后一行留给状态
+        size_t visible = static_cast<size_t>(std::max(1, GetClientSize().GetHeight() / lineHeight - 1));
+
+        uint64_t first, end;
+        store->GetRows(first, end);
+        if (first == end) {
+            dc.DrawText("No data", left, 0);
+            return;
+        }
+        if (follow || topRow + visible > end) topRow = end > visible ? end - visible : 0;
+        topRow = std::max(topRow, first);
+
+        // 缓冲区只在窗口变高时增长
+        if (text.size() < visible * HEX_ROW_CHARS) text.resize(visible * HEX_ROW_CHARS);
+        if (directions.size() < visible) directions.resize(visible);
+        size_t rows = store->FormatRows(topRow, visible, text.data(), directions.data());
+
+        static const wxColour rxColour(0, 0, 0), txColour(0, 70, 200);
+        for (size_t i = 0; i < rows; i++) {
+            dc.SetTextForeground(directions[i] == CAPTURE_TX ? txColour : rxColour);
+            dc.DrawText(wxString(&text[i * HEX_ROW_CHARS], HEX_ROW_CHARS), left, static_cast<int>(i) * lineHeight);
+        }
+
+        dc.SetTextForeground(*wxLIGHT_GREY);
+        dc.DrawText(wxString::Format("Rows %llu - %llu of %llu%s",
+                                     (unsigned long long)(topRow - first + 1),
+                                     (unsigned long long)(topRow - first + rows),
+                                     (unsigned long long)(end - first), follow ? " (live)" : ""),
+                    left, static_cast<int>(visible) * lineHeight);
+    }
+
+    void OnWheel(wxMouseEvent& event) {
+        int delta = event.GetWheelDelta() > 0 ? event.GetWheelDelta() : 120;
+        int64_t lines = -static_cast<int64_t>(event.GetWheelRotation()) * 3 / delta;
+        if (lines == 0) return;
+        uint64_t first, end;
+        store->GetRows(first, end);
+        if (lines < 0) {
+            uint64_t up = static_cast<uint64_t>(-lines);
+            topRow = topRow > first + up ? topRow - up : first;
+            follow = false;
+        } else {
+            // 翻到底部后 OnPaint 会把 topRow 限制在最后一页
+            topRow += static_cast<uint64_t>(lines);
+        }
+        Refresh();
+    }
+
+    void OnDoubleClick(wxMouseEvent& event) {
+        follow = true;
+        Refresh();
+    }
+
+    HexDumpStore* store;
+    bool follow;
+    uint64_t topRow;            // 窗口第一行的行号
+    uint32_t shownVersion;      // 上次重画时的数据版本
+    wxFont font;
+    std::vector<char> text;
+    std::vector<int> directions;
+};
+
+// 多端口生产工位窗口：每个端口一行，显示烧录进度和结果
+class StationFrame : public wxFrame {
+public:
+    StationFrame(wxWindow* parent, const wxArrayString& ports, int baud, int mode,
+                 const wxString& imagePath, const wxString& address,
+                 const wxString& firstSn, bool autoIncrement)
+        : wxFrame(parent, wxID_ANY, "Production Station", wxDefaultPosition, wxDefaultSize),
+          baudRate(baud), frameMode(static_cast<FrameMode>(mode)), refreshTimer(this, ID_STATION_TIMER) {
+        SetSize(FromDIP(wxSize(760, 520)));
+
+        wxPanel* panel = new wxPanel(this);
+        wxBoxSizer* vbox = new wxBoxSizer(wxVERTICAL);
+        const int margin = FromDIP(5);
+
+        wxBoxSizer* topSizer = new wxBoxSizer(wxHORIZONTAL);
+
+        // 端口列表，每行一个
+        wxString portText;
+        for (size_t i = 0; i < ports.size(); i++) {
+            portText += ports[i] + "\n";
+        }
+        portsEntry = new wxTextCtrl(panel, wxID_ANY, portText, wxDefaultPosition,
+                                    FromDIP(wxSize(140, 120)), wxTE_MULTILINE);
+        topSizer->Add(portsEntry, 0, wxEXPAND | wxALL, margin);
+
+        wxFlexGridSizer* grid = new wxFlexGridSizer(2, margin, margin);
+        grid->AddGrowableCol(1, 1);
+        grid->Add(new wxStaticText(panel, wxID_ANY, "Image:"), 0, wxALIGN_CENTER_VERTICAL);
+        imageEntry = new wxTextCtrl(panel, wxID_ANY, imagePath);
+        grid->Add(imageEntry, 1, wxEXPAND);
+        grid->Add(new wxStaticText(panel, wxID_ANY, "Addr:"), 0, wxALIGN_CENTER_VERTICAL);
+        addrEntry = new wxTextCtrl(panel, wxID_ANY, address);
+        grid->Add(addrEntry, 1, wxEXPAND);
+        grid->Add(new wxStaticText(panel, wxID_ANY, "First SN:"), 0, wxALIGN_CENTER_VERTICAL);
+        snEntry = new wxTextCtrl(panel, wxID_ANY, firstSn);
+        grid->Add(snEntry, 1, wxEXPAND);
+        grid->AddSpacer(0);
+        autoIncCheck = new wxCheckBox(panel, wxID_ANY, "Auto Inc SN");
+        autoIncCheck->SetValue(autoIncrement);
+        grid->Add(autoIncCheck, 0);
+        topSizer->Add(grid, 1, wxEXPAND | wxALL, margin);
+
+        startBtn = new wxButton(panel, wxID_ANY, "Start");
+        topSizer->Add(startBtn, 0, wxALL, margin);
+        vbox->Add(topSizer, 0, wxEXPAND);
+
+        portList = new wxListCtrl(panel, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+                                  wxLC_REPORT | wxLC_SINGLE_SEL);
+        portList->InsertColumn(0, "Port", wxLIST_FORMAT_LEFT, FromDIP(90));
+        portList->InsertColumn(1, "State", wxLIST_FORMAT_LEFT, FromDIP(90));
+        portList->InsertColumn(2, "Progress", wxLIST_FORMAT_RIGHT, FromDIP(60));
+        portList->InsertColumn(3, "KB/s", wxLIST_FORMAT_RIGHT, FromDIP(60));
+        portList->InsertColumn(4, "SN", wxLIST_FORMAT_LEFT, FromDIP(130));
+        portList->InsertColumn(5, "Message", wxLIST_FORMAT_LEFT, FromDIP(300));
+        vbox->Add(portList, 1, wxEXPAND | wxALL, margin);
+
+        summaryText = new wxStaticText(panel, wxID_ANY, "Idle");
+        vbox->Add(summaryText, 0, wxEXPAND | wxALL, margin);
+
+        panel->SetSizer(vbox);
+        Centre();
+
+        startBtn->Bind(wxEVT_BUTTON, &StationFrame::OnStart, this);
+        Bind(wxEVT_TIMER, &StationFrame::OnRefresh, this, ID_STATION_TIMER);
+        Bind(wxEVT_CLOSE_WINDOW, &StationFrame::OnClose, this);
+    }
+
+private:
+    enum {
+        ID_STATION_TIMER = wxID_HIGHEST + 100
+    };
+
+    void OnStart(wxCommandEvent& event) {
+        if (refreshTimer.IsRunning()) {
+            StopStation();
+            return;
+        }
+
+        std::vector<std::string> ports;
+        wxArrayString lines = wxSplit(portsEntry->GetValue(), '\n');
+        for (size_t i = 0; i < lines.size(); i++) {
+            wxString name = lines[i].Trim().Trim(false);
+            if (!name.IsEmpty()) ports.push_back(name.ToStdString());
+        }
+        if (ports.empty()) {
+            summaryText->SetLabel("Error: No ports");
+            return;
+        }
+
+        unsigned long address = 0;
+        if (!addrEntry->GetValue().ToULong(&address, 16)) {
+            summaryText->SetLabel("Error: Invalid flash address");
+            return;
+        }
+        std::ifstream file(imageEntry->GetValue().ToStdString(), std::ios::binary);
+        std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (image.empty()) {
+            summaryText->SetLabel("Error: Could not read " + imageEntry->GetValue());
+            return;
+        }
+
+        station.SetImage(image, static_cast<uint32_t>(address));
+        station.SetSerialNumbers(snEntry->GetValue().Trim().Trim(false).ToStdString(), autoIncCheck->IsChecked());
+        station.Start(ports, baudRate, frameMode);
+
+        portList->DeleteAllItems();
+        for (size_t i = 0; i < ports.size(); i++) {
+            portList->InsertItem(i, ports[i]);
+        }
+        startBtn->SetLabel("Stop");
+        refreshTimer.Start(250);
+    }
+
+    void StopStation() {
+        refreshTimer.Stop();
+        station.Stop();
+        UpdateList();
+        startBtn->SetLabel("Start");
+    }
+
+    void OnRefresh(wxTimerEvent& event) {
+        UpdateList();
+        // 所有端口都结束后自动停止，下一个序列号回填到输入框
+        if (!station.IsBusy()) StopStation();
+    }
+
+    void UpdateList() {
+        std::vector<StationPortStatus> status = station.GetStatus();
+        int running = 0, passed = 0, failed = 0;
+        double totalRate = 0;
+        for (size_t i = 0; i < status.size() && i < (size_t)portList->GetItemCount(); i++) {
+            const StationPortStatus& s = status[i];
+            SetCell(i, 1, StationStateName(s.state));
+            SetCell(i, 2, wxString::Format("%d%%", s.percent));
+            SetCell(i, 3, s.bytesPerSecond > 0 ? wxString::Format("%.1f", s.bytesPerSecond / 1024) : wxString());
+            SetCell(i, 4, s.sn);
+            SetCell(i, 5, s.message);
+
+            if (s.state == STATION_DONE) passed++;
+            else if (s.state == STATION_FAILED) failed++;
+            else running++;
+            totalRate += s.bytesPerSecond;
+        }
+        summaryText->SetLabel(wxString::Format("Running: %d  Passed: %d  Failed: %d  Total: %.1f KB/s",
+                                               running, passed, failed, totalRate / 1024));
+        if (autoIncCheck->IsChecked()) {
+            snEntry->ChangeValue(station.GetNextSerialNumber());
+        }
+    }
+
+    // 内容没变的格子不重绘，避免列表闪烁
+    void SetCell(long row, int column, const wxString& text) {
+        if (portList->GetItemText(row, column) != text) {
+            portList->SetItem(row, column, text);
+        }
+    }
+
+    void OnClose(wxCloseEvent& event) {
+        refreshTimer.Stop();
+        station.Stop();
+        event.Skip();
+    }
+
+    wxTextCtrl* portsEntry;
+    wxTextCtrl* imageEntry;
+    wxTextCtrl* addrEntry;
+    wxTextCtrl* snEntry;
+    wxCheckBox* autoIncCheck;
+    wxButton* startBtn;
+    wxListCtrl* portList;
+    wxStaticText* summaryText;
+
+    int baudRate;
+    FrameMode frameMode;
+    wxTimer refreshTimer;
+    ProductionStation station;
+};
 
 class SerialFrame : public wxFrame {
 private:
     // 现有的成员变量
     wxComboBox* portCombo;
     wxComboBox* baudCombo;
+    wxComboBox* framingCombo;
     wxButton* refreshBtn;
     wxButton* connectBtn;
+    wxButton* stationBtn;
     wxNotebook* notebook;
     wxTextCtrl* logText;
     wxTextCtrl* sendText;
     wxButton* sendBtn;
+    wxButton* captureBtn;
+    wxButton* replayBtn;
+    wxComboBox* replaySpeedCombo;
     wxStatusBar* statusBar;
 
     // Battery 面板相关的成员变量
@@ -41,138 +535,332 @@ private:
     wxCheckBox* autoIncCheck;
     wxTextCtrl* snEntry;
 
-    // 串口通信相关成员
-    HANDLE hSerial;
-    std::thread* serialThread;
+    // 遥测显示相关成员
+    wxTimer* telemetryTimer;
+    PlotPanel* plotPanel;
+    uint32_t telemetryVersion;
+    wxString shownValues[8];    // 各输入框当前显示的内容，只更新有变化的
+
+    // 固件下载相关成员
+    wxTextCtrl* otaPathEntry;
+    wxButton* otaSelectBtn;
+    wxButton* otaDownloadBtn;
+    wxGauge* otaGauge;
+    wxStaticText* otaRateLabel;
+    wxTextCtrl* otaAddrEntry;
+    wxButton* otaUpdateBtn;
+    wxCheckBox* fastLinkCheck;
+    FirmwareJob* firmwareJob;
+    int connectedBaud;
+    // 勾选 Fast link 时传输前协商更高的速率，结束后切回；协商期间不能中止
+    BaudNegotiator* linkSpeed;
+    bool negotiating;
+    // 提速后传输失败时切回原速率、降一档重新协商，再用 makeFirmwareJob 创建同样的任务重试
+    // （FlashDiffUpdate 会跳过已经写好的块）；retryBelowBaud 非 0 表示切回后要重试
+    static const int MAX_FIRMWARE_ATTEMPTS = 3;
+    std::function<FirmwareJob*()> makeFirmwareJob;
+    int firmwareAttempts;
+    int retryBelowBaud;
+    bool firmwareAborted;
+    // 每次断开连接加一；下载和协商的事件带上投递时的值，不一致的是旧连接关闭时取消回调投递的，直接丢弃
+    uint32_t linkGeneration;
+
+    // 串口通信相关成员：串口、接收线程、分帧、命令引擎和遥测快照
+    BatteryLink link;
+    PortDiscovery portDiscovery;
     std::atomic<bool> isRunning;
     
     // 添加一个标志来追踪断开连接的状态
     std::atomic<bool> isDisconnecting;
     
     // 添加发送队列相关成员
-    std::queue<wxString> sendQueue;
+    std::queue<SendItem> sendQueue;
     std::mutex sendMutex;
     std::atomic<bool> isSending;
     std::condition_variable sendCondition;
     std::thread* sendThread;
 
-    // 串口通信相关函数
-    bool OpenSerial(const wxString& portName, int baudRate) {
-        // 确保端口名称格式正确（如果用户只输入了 "COM3"，需要加上完整路径）
-        wxString fullPortName = portName;
-        if (!portName.StartsWith("\\\\.\\")) {
-            fullPortName = "\\\\.\\" + portName;
+    // 收发链路指标，状态栏显示，可定期导出到文件
+    PipelineMetrics metrics;
+    MetricsSnapshot lastMetrics;
+    wxTimer* metricsTimer;
+    std::string metricsPath;
+
+    // 全部日志都进索引；设置了过滤条件时日志框只显示匹配的行
+    wxTextCtrl* filterText;
+    wxCheckBox* regexCheck;
+    wxCheckBox* caseCheck;
+    wxStaticText* filterLabel;
+    LogIndex logIndex;
+    LogMatcher logFilter;
+    size_t filterMatches;
+    // 过滤在查找线程里做：输入停顿 FILTER_DELAY_MS 后才提交，线程只处理最新的请求。
+    // 只有界面线程写索引，写入时持 logIndexMutex；查找线程持锁读，
+    // 这期间界面线程不等锁，新日志先放进 deferredLog，下次拿到锁时补进索引
+    wxTimer* filterTimer;
+    std::mutex logIndexMutex;
+    std::vector<std::pair<int64_t, std::string> > deferredLog;
+    std::thread* searchThread;
+    std::mutex searchMutex;
+    std::condition_variable searchCondition;
+    LogMatcher searchMatcher;
+    uint32_t searchGeneration;
+    bool searchActive;
+
+    // 收发的原始字节另存一份，切到十六进制视图时显示；
+    // 十六进制视图下日志照样进索引，只是不追加到隐藏的日志框，切回文本视图时从索引重建
+    wxComboBox* viewCombo;
+    HexView* hexView;
+    HexDumpStore hexStore;
+    std::atomic<bool> hexMode;
+
+    void OnViewChanged(wxCommandEvent& event) {
+        bool hex = viewCombo->GetSelection() == 1;
+        hexMode = hex;
+        logText->Show(!hex);
+        hexView->Show(hex);
+        filterText->Enable(!hex);
+        regexCheck->Enable(!hex);
+        caseCheck->Enable(!hex);
+        logText->GetParent()->Layout();
+        if (hex) hexView->Refresh();
+        else RefreshLogView();
+    }
+
+    // 所有日志都从这里写入：先进索引，过滤时只追加新完成的行里匹配的
+    void AppendLog(const wxString& text) {
+        wxCharBuffer buffer = text.ToUTF8();
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        deferredLog.push_back(std::make_pair(now, std::string(buffer.data(), buffer.length())));
+
+        size_t first = logIndex.GetLineCount();
+        bool indexed = FlushDeferredLog();
+        if (hexMode) return;
+        if (logFilter.IsEmpty()) {
+            logText->AppendText(text);
+            TrimLogView();
+            return;
         }
-        
-        hSerial = CreateFile(fullPortName.wc_str(),
-                           GENERIC_READ | GENERIC_WRITE,
-                           0,
-                           0,
-                           OPEN_EXISTING,
-                           FILE_ATTRIBUTE_NORMAL,
-                           0);
-                           
-        if (hSerial == INVALID_HANDLE_VALUE) {
-            DWORD error = GetLastError();
-            wxString errorMsg = wxString::Format(
-                "Failed to open serial port: %s\nError code: %d\n", 
-                fullPortName, error);
-            wxMessageBox(errorMsg, "Error", wxOK | wxICON_ERROR);
-            return false;
-        }
-
-        // 设置串口参数
-        DCB dcbSerialParams = {0};
-        dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
-        
-        if (!GetCommState(hSerial, &dcbSerialParams)) {
-            CloseHandle(hSerial);
-            wxMessageBox("Error getting serial port state", "Error", wxOK | wxICON_ERROR);
-            return false;
+        // 没进索引的行等查找结果回来时一起补查
+        if (!indexed) return;
+        std::vector<uint32_t> hits;
+        logIndex.Search(logFilter, first, hits);
+        if (hits.empty()) return;
+        filterMatches += hits.size();
+        logText->AppendText(FormatLogLines(hits, 0, true));
+        TrimLogView();
+        filterLabel->SetLabel(wxString::Format("%u matches", (unsigned)filterMatches));
+    }
+
+    // 把攒下的日志写进索引；查找线程正在读索引时不等，返回 false
+    bool FlushDeferredLog() {
+        std::unique_lock<std::mutex> lock(logIndexMutex, std::try_to_lock);
+        if (!lock.owns_lock()) return false;
+        for (size_t i = 0; i < deferredLog.size(); i++) {
+            logIndex.Append(deferredLog[i].second.data(), deferredLog[i].second.size(), deferredLog[i].first);
         }
+        deferredLog.clear();
+        return true;
+    }
 
-        dcbSerialParams.BaudRate = baudRate;
-        dcbSerialParams.ByteSize = 8;
-        dcbSerialParams.StopBits = ONESTOPBIT;
-        dcbSerialParams.Parity = NOPARITY;
-        
-        // 优化串口设置
-        dcbSerialParams.fBinary = TRUE;
-        dcbSerialParams.fDtrControl = DTR_CONTROL_ENABLE;
-        dcbSerialParams.fRtsControl = RTS_CONTROL_ENABLE;
-        dcbSerialParams.fOutxCtsFlow = FALSE;
-        dcbSerialParams.fOutxDsrFlow = FALSE;
-        dcbSerialParams.fDsrSensitivity = FALSE;
-        dcbSerialParams.fAbortOnError = FALSE;
+    // 日志框超过 LOG_VIEW_LINES + LOG_TRIM_LINES 行时删到 LOG_VIEW_LINES 行
+    void TrimLogView() {
+        int lines = logText->GetNumberOfLines();
+        if (lines <= static_cast<int>(LOG_VIEW_LINES + LOG_TRIM_LINES)) return;
+        logText->Remove(0, logText->XYToPosition(0, lines - static_cast<int>(LOG_VIEW_LINES)));
+    }
 
-        if (!SetCommState(hSerial, &dcbSerialParams)) {
-            CloseHandle(hSerial);
-            wxMessageBox("Error setting serial port state", "Error", wxOK | wxICON_ERROR);
-            return false;
+    // 把索引里的行拼成显示文本，过滤结果每行前加上到达时间
+    wxString FormatLogLines(const std::vector<uint32_t>& rows, size_t begin, bool withTime) {
+        std::string text;
+        for (size_t i = begin; i < rows.size(); i++) {
+            if (withTime) {
+                int64_t ms = logIndex.GetLineTime(rows[i]);
+                time_t seconds = static_cast<time_t>(ms / 1000);
+                struct tm* t = localtime(&seconds);
+                char stamp[32];
+                snprintf(stamp, sizeof(stamp), "[%02d:%02d:%02d.%03d] ", t->tm_hour, t->tm_min, t->tm_sec, (int)(ms % 1000));
+                text += stamp;
+            }
+            size_t length;
+            const char* line = logIndex.GetLine(rows[i], length);
+            text.append(line, length);
+            text += '\n';
         }
+        return wxString::FromUTF8(text.data(), text.size());
+    }
 
-        // 设置缓冲区大小
-        if (!SetupComm(hSerial, 1024, 1024)) {  // 设置输入输出缓冲区大小
-            CloseHandle(hSerial);
-            return false;
+    // 过滤条件变化：停止输入 FILTER_DELAY_MS 后再查找，连续输入只查最后一次
+    void OnFilterChanged(wxCommandEvent& event) {
+        filterTimer->Start(FILTER_DELAY_MS, wxTIMER_ONE_SHOT);
+    }
+
+    void OnFilterTimer(wxTimerEvent& event) {
+        wxCharBuffer pattern = filterText->GetValue().ToUTF8();
+        std::string error;
+        LogMatcher matcher;
+        if (!matcher.Compile(std::string(pattern.data(), pattern.length()), regexCheck->GetValue(),
+                             !caseCheck->GetValue(), error)) {
+            filterLabel->SetLabel("Invalid regex");
+            return;
         }
+        logFilter = matcher;
+        RefreshLogView();
+    }
 
-        // 设置超时
-        COMMTIMEOUTS timeouts = {0};
-        timeouts.ReadIntervalTimeout = MAXDWORD;
-        timeouts.ReadTotalTimeoutConstant = 0;
-        timeouts.ReadTotalTimeoutMultiplier = 0;
-        timeouts.WriteTotalTimeoutConstant = 1;
-        timeouts.WriteTotalTimeoutMultiplier = 0;
+    // 按当前过滤条件重建日志框：没有过滤时直接取最近的行，有过滤时交给查找线程
+    void RefreshLogView() {
+        if (!logFilter.IsEmpty()) {
+            {
+                std::lock_guard<std::mutex> lock(searchMutex);
+                searchMatcher = logFilter;
+                searchGeneration++;
+            }
+            searchCondition.notify_one();
+            filterLabel->SetLabel("Searching...");
+            return;
+        }
 
-        if (!SetCommTimeouts(hSerial, &timeouts)) {
-            CloseHandle(hSerial);
-            return false;
+        // 取消过滤：恢复最近的日志
+        std::vector<uint32_t> rows;
+        wxString header;
+        size_t count = logIndex.GetLineCount();
+        for (size_t i = count > LOG_VIEW_LINES ? count - LOG_VIEW_LINES : 0; i < count; i++) {
+            rows.push_back(static_cast<uint32_t>(i));
         }
+        if (count > LOG_VIEW_LINES) {
+            header = wxString::Format("(%u earlier lines, use the filter to search them)\n",
+                                      (unsigned)(count - LOG_VIEW_LINES));
+        }
+        filterLabel->SetLabel("");
+        ShowLogLines(header, rows);
+    }
 
-        return true;
+    // 日志框只保留最近的 LOG_VIEW_LINES 行结果
+    void ShowLogLines(const wxString& header, const std::vector<uint32_t>& rows) {
+        size_t begin = rows.size() > LOG_VIEW_LINES ? rows.size() - LOG_VIEW_LINES : 0;
+        logText->Freeze();
+        logText->ChangeValue(header + FormatLogLines(rows, begin, !logFilter.IsEmpty()));
+        logText->SetInsertionPointEnd();
+        logText->Thaw();
     }
 
-    void CloseSerial() {
-        if (hSerial != INVALID_HANDLE_VALUE) {
-            CloseHandle(hSerial);
-            hSerial = INVALID_HANDLE_VALUE;
+    // 查找线程：每次取最新的过滤条件查全部索引，处理期间来的请求只保留最后一个
+    void SearchThreadFunction() {
+        std::unique_lock<std::mutex> lock(searchMutex);
+        uint32_t done = 0;
+        while (true) {
+            searchCondition.wait(lock, [&] { return !searchActive || searchGeneration != done; });
+            if (!searchActive) break;
+            LogSearchResult result;
+            result.generation = done = searchGeneration;
+            result.matcher = searchMatcher;
+            lock.unlock();
+
+            int64_t start = MetricsNow();
+            {
+                std::lock_guard<std::mutex> indexLock(logIndexMutex);
+                result.lines = logIndex.GetLineCount();
+                result.compared = logIndex.Search(result.matcher, 0, result.rows);
+            }
+            result.ms = (MetricsNow() - start) / 1e6;
+            wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_LOG_SEARCH);
+            event->SetPayload(result);
+            wxQueueEvent(this, event);
+            lock.lock();
         }
     }
 
-    // 串口数据接收线程
-    void SerialThread() {
-        char buffer[1024];
-        DWORD bytesRead;
+    // 查找结果：过时的丢弃；查找期间攒下的日志补进索引，再补查查找之后追加的行
+    void OnLogSearch(wxThreadEvent& event) {
+        LogSearchResult result = event.GetPayload<LogSearchResult>();
+        {
+            std::lock_guard<std::mutex> lock(searchMutex);
+            if (result.generation != searchGeneration) return;
+        }
+        if (logFilter.IsEmpty()) return;
+        FlushDeferredLog();
+        result.compared += logIndex.Search(result.matcher, result.lines, result.rows);
+        filterMatches = result.rows.size();
+        filterLabel->SetLabel(wxString::Format("%u matches, %u of %u lines checked, %.1f ms",
+                                               (unsigned)result.rows.size(), (unsigned)result.compared,
+                                               (unsigned)logIndex.GetLineCount(), result.ms));
+        if (hexMode) return;
+        wxString header;
+        if (result.rows.size() > LOG_VIEW_LINES) {
+            header = wxString::Format("(%u earlier matches not shown)\n",
+                                      (unsigned)(result.rows.size() - LOG_VIEW_LINES));
+        }
+        ShowLogLines(header, result.rows);
+    }
 
-        while (isRunning) {
-            if (ReadFile(hSerial, buffer, sizeof(buffer) - 1, &bytesRead, NULL) && bytesRead > 0) {
-                buffer[bytesRead] = '\0';
-                // 创建事件并设置数据
-                wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_SERIAL_DATA);
-                event->SetString(wxString(buffer, wxConvUTF8));
-                wxQueueEvent(this, event);
-            }
-            wxMilliSleep(10);  // 避免过度占用CPU
+    // 文本模式下的原始数据（接收线程中执行）
+    void OnLinkRaw(const uint8_t* data, size_t length) {
+        // 十六进制视图也要投递，接收的文本照样进日志索引
+        // 创建事件并设置数据
+        wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_SERIAL_DATA);
+        event->SetString(wxString::FromUTF8(reinterpret_cast<const char*>(data), length));
+        event->SetPayload(MetricsNow());
+        wxQueueEvent(this, event);
+    }
+
+    // 分帧层回调（在接收线程中执行），把帧拷贝出来交给界面线程
+    // 遥测帧和命令应答已经由 BatteryLink 处理，这里只收到其余的帧
+    void OnLinkFrame(const BatteryFrame& frame) {
+        FramePacket packet;
+        packet.type = frame.type;
+        packet.seq = frame.seq;
+        packet.data.assign(frame.data, frame.data + frame.length);
+        packet.queued = MetricsNow();
+
+        wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_SERIAL_FRAME);
+        event->SetPayload(packet);
+        wxQueueEvent(this, event);
+    }
+
+    void OnLinkError(const std::string& message) {
+        wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_SEND_ERROR);
+        event->SetString(wxString::FromUTF8(message.c_str()));
+        wxQueueEvent(this, event);
+    }
+
+    // 关闭连接（界面线程中调用）。下载对象的回调来自命令引擎，连接关闭（引擎删除）后才能删除
+    void CloseLink() {
+        linkGeneration++;
+        link.Close();
+        DeleteFirmwareObjects();
+    }
+
+    // 只在界面线程中调用：OnOtaDone、OnLinkSpeed 等也在界面线程里使用这两个对象
+    void DeleteFirmwareObjects() {
+        if (firmwareJob) {
+            delete firmwareJob;
+            firmwareJob = nullptr;
+        }
+        if (linkSpeed) {
+            delete linkSpeed;
+            linkSpeed = nullptr;
         }
+        // 协商中断开的，不复位的话下载按钮会一直被 AbortFirmwareJob 吞掉
+        negotiating = false;
+        retryBelowBaud = 0;
+        firmwareAttempts = 0;
+        firmwareAborted = false;
     }
 
     // 发送线程
     void SendThreadFunction() {
-        DWORD bytesWritten;
-        COMMTIMEOUTS timeouts = {0};
-        timeouts.WriteTotalTimeoutConstant = 1;    // 1ms超时
-        timeouts.WriteTotalTimeoutMultiplier = 0;
-        
         while (isRunning) {
-            wxString dataToSend;
+            SendItem item;
             bool hasData = false;
             
             {
                 std::unique_lock<std::mutex> lock(sendMutex);
                 if (!sendQueue.empty()) {
-                    dataToSend = sendQueue.front();
+                    item = sendQueue.front();
                     sendQueue.pop();
+                    metrics.sendQueueDepth--;
                     hasData = true;
                 } else {
                     // 如果队列为空，等待新数据
@@ -185,21 +873,19 @@ private:
             if (!isRunning) break;
             
             if (hasData) {
-                SetCommTimeouts(hSerial, &timeouts);
-                wxCharBuffer buffer = dataToSend.ToUTF8();
+                wxCharBuffer buffer = item.data.ToUTF8();
                 size_t dataLength = strlen(buffer.data());
 
-                if (WriteFile(hSerial, buffer.data(), dataLength, &bytesWritten, NULL)) {
-                    FlushFileBuffers(hSerial);
-                    
+                if (link.Write(reinterpret_cast<const uint8_t*>(buffer.data()), dataLength)) {
+                    metrics.enqueueToWrite.Record(MetricsNow() - item.queued);
                     // 发送成功，通知UI更新
                     wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_SEND_COMPLETE);
-                    event->SetString(dataToSend);
+                    event->SetString(item.data);
                     wxQueueEvent(this, event);
                 } else {
                     // 发送失败，通知UI
                     wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_SEND_ERROR);
-                    event->SetString("Send failed: " + wxString::Format("Error code: %d", GetLastError()));
+                    event->SetString("Send failed");
                     wxQueueEvent(this, event);
                 }
             }
@@ -208,16 +894,15 @@ private:
 
     // 发送数据
     bool SendSerialData(const wxString& data) {
-        if (hSerial == INVALID_HANDLE_VALUE) return false;
+        if (!link.IsOpen()) return false;
 
-        DWORD bytesWritten;
         wxCharBuffer buffer = data.ToUTF8();
-        return WriteFile(hSerial, buffer.data(), strlen(buffer.data()), &bytesWritten, NULL) != 0;
+        return link.Write(reinterpret_cast<const uint8_t*>(buffer.data()), strlen(buffer.data()));
     }
 
     // 事件处理函数
     void OnConnect(wxCommandEvent& event) {
-        if (hSerial == INVALID_HANDLE_VALUE) {
+        if (!link.IsOpen()) {
             wxString portName = portCombo->GetValue();
             if (portName.empty()) {
                 wxMessageBox("Please select a COM port", "Error", wxOK | wxICON_ERROR);
@@ -230,12 +915,14 @@ private:
                 return;
             }
 
-            if (OpenSerial(portName, baudRate)) {
-                isRunning = true;
-                serialThread = new std::thread(&SerialFrame::SerialThread, this);
-                sendThread = new std::thread(&SerialFrame::SendThreadFunction, this);
-                connectBtn->SetLabel("Disconnect");
-                statusBar->SetStatusText("Connected to " + portName);
+            // 按选择的分帧方式打开连接，接收线程由 BatteryLink 创建
+            FrameMode mode = static_cast<FrameMode>(framingCombo->GetSelection());
+            std::string error;
+            if (!link.Open(portName.ToStdString(), baudRate, mode, error)) {
+                wxMessageBox(wxString::FromUTF8(error.c_str()), "Error", wxOK | wxICON_ERROR);
+            } else {
+                connectedBaud = baudRate;
+                OnLinkOpened("Connected to " + portName);
             }
         } else {
             
@@ -252,60 +939,130 @@ private:
             if (!isDisconnecting) {
                 isDisconnecting = true;
                 isRunning = false;
+                linkGeneration++;
                 
-                // 创建一个新线程来处理断开连接
+                // 创建一个新线程来处理断开连接；线程只关闭连接，下载对象在 OnDisconnectComplete 里删除
                 std::thread([this]() {
-                    if (serialThread) {
-                        serialThread->join();
-                        delete serialThread;
-                        serialThread = nullptr;
-                    }
-                    CloseSerial();
-                    
+                    link.Close();
+
                     // 使用事件来更新UI
                     wxQueueEvent(this, new wxThreadEvent(wxEVT_THREAD, ID_DISCONNECT_COMPLETE));
                 }).detach();
 
-                // 立即禁用连接按钮，防止重复点击
+                // 立即禁用连接按钮，防止重复点击；断开完成前也不能发命令或开始下载
                 connectBtn->Enable(false);
+                EnableLinkButtons(false);
             }
 
             
         }
     }
 
+    // 串口或回放打开后启动发送线程，连接按钮变为断开
+    void OnLinkOpened(const wxString& status) {
+        isRunning = true;
+        sendThread = new std::thread(&SerialFrame::SendThreadFunction, this);
+        connectBtn->SetLabel("Disconnect");
+        replayBtn->Enable(false);
+        statusBar->SetStatusText(status);
+    }
+
+    // 开始/停止抓包，收发的原始字节带时间戳写入文件
+    void OnCapture(wxCommandEvent& event) {
+        if (link.IsCapturing()) {
+            uint64_t bytes = link.GetCaptureBytes();
+            link.StopCapture();
+            captureBtn->SetLabel("Record...");
+            AppendLog(wxString::Format("Capture stopped, %llu bytes\n", (unsigned long long)bytes));
+            return;
+        }
+
+        wxFileDialog saveFileDialog(this, "Save Capture", "", "capture.wxcap",
+                                    "Capture files (*.wxcap)|*.wxcap", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (saveFileDialog.ShowModal() != wxID_OK) return;
+
+        std::string error;
+        if (!link.StartCapture(saveFileDialog.GetPath().ToStdString(), error)) {
+            wxMessageBox(wxString::FromUTF8(error.c_str()), "Error", wxOK | wxICON_ERROR);
+            return;
+        }
+        captureBtn->SetLabel("Stop Rec");
+        AppendLog("Capture started: " + saveFileDialog.GetPath() + "\n");
+    }
+
+    // 回放抓包文件，按当前选择的分帧方式解码，界面与连接真实设备时相同
+    void OnReplay(wxCommandEvent& event) {
+        if (link.IsOpen()) return;
+
+        wxFileDialog openFileDialog(this, "Replay Capture", "", "",
+                                    "Capture files (*.wxcap)|*.wxcap", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+        if (openFileDialog.ShowModal() != wxID_OK) return;
+
+        // "Max" 不按时间间隔等待，用于离线压测界面
+        double speed = 0;
+        wxString speedText = replaySpeedCombo->GetValue();
+        if (speedText != "Max") {
+            speedText.BeforeFirst('x').ToDouble(&speed);
+        }
+
+        FrameMode mode = static_cast<FrameMode>(framingCombo->GetSelection());
+        std::string error;
+        if (!link.OpenReplay(openFileDialog.GetPath().ToStdString(), mode, speed, error)) {
+            wxMessageBox(wxString::FromUTF8(error.c_str()), "Error", wxOK | wxICON_ERROR);
+            return;
+        }
+        connectedBaud = 0;
+        OnLinkOpened("Replaying " + openFileDialog.GetFilename());
+    }
+
     void OnDisconnectComplete(wxThreadEvent& event) {
+        // 连接已关闭，命令引擎不会再回调下载对象
+        DeleteFirmwareObjects();
+        isDisconnecting = false;
+        EnableLinkButtons(true);
+
         // 在主线程中更新UI
         connectBtn->SetLabel("Connect");
         connectBtn->Enable(true);
+        replayBtn->Enable(true);
         statusBar->SetStatusText("Disconnected");
-        isDisconnecting = false;
     }
 
     void OnSend(wxCommandEvent& event) {
-        if (hSerial != INVALID_HANDLE_VALUE) {
+        if (link.IsOpen()) {
             wxString data = sendText->GetValue();
             if (!data.empty()) {
                 {
                     std::lock_guard<std::mutex> lock(sendMutex);
-                    sendQueue.push(data);
+                    SendItem item;
+                    item.data = data;
+                    item.queued = MetricsNow();
+                    sendQueue.push(item);
+                    metrics.sendQueueDepth++;
                 }
                 sendCondition.notify_one();
                 sendText->Clear();
             }
         } else {
-            logText->AppendText("Error: Serial port not open\n");
+            AppendLog("Error: Serial port not open\n");
         }
     }
     void OnSerialData(wxThreadEvent& event) {
         // 直接从事件获取字符串
         wxString data = event.GetString();
-        logText->AppendText("RX: " + data + "\n");
+        AppendLog("RX: " + data + "\n");
+        metrics.eventToUi.Record(MetricsNow() - event.GetPayload<int64_t>());
+    }
+    void OnSerialFrame(wxThreadEvent& event) {
+        FramePacket packet = event.GetPayload<FramePacket>();
+        AppendLog(wxString::Format("RX frame: type 0x%02X, seq %u, %u bytes\n",
+                                             packet.type, packet.seq, (unsigned)packet.data.size()));
+        metrics.eventToUi.Record(MetricsNow() - packet.queued);
     }
     // 添加发送完成事件处理
     void OnSendComplete(wxThreadEvent& event) {
         wxString data = event.GetString();
-        logText->AppendText("TX: " + data + "\n");
+        AppendLog("TX: " + data + "\n");
     }
     wxPanel* CreateBatteryPanel(wxWindow* parent) {
         wxPanel* batteryPanel = new wxPanel(parent);
@@ -407,57 +1164,471 @@ private:
         return batteryPanel;
     }
 
-    void OnRefreshPorts(wxCommandEvent& event) {
-        portCombo->Clear();
-        
-        HDEVINFO hDevInfo = SetupDiGetClassDevs(&GUID_DEVCLASS_PORTS, NULL, NULL, DIGCF_PRESENT);
-        if (hDevInfo == INVALID_HANDLE_VALUE) {
-            wxMessageBox("Failed to get device information", "Error", wxOK | wxICON_ERROR);
+    // 提交电池命令，结果通过 ID_COMMAND_DONE 事件回到界面线程
+    void SubmitBatteryCommand(uint8_t command, const std::vector<uint8_t>& payload) {
+        CommandEngine* commandEngine = link.GetEngine();
+        if (!commandEngine) {
+            AppendLog("Error: Serial port not open in binary framing mode\n");
             return;
         }
+        commandEngine->Submit(command, payload, [this](const CommandResult& result) {
+            wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_COMMAND_DONE);
+            event->SetPayload(result);
+            wxQueueEvent(this, event);
+        });
+    }
+
+    void OnReset(wxCommandEvent& event) {
+        SubmitBatteryCommand(CMD_RESET, std::vector<uint8_t>());
+    }
 
-        SP_DEVINFO_DATA devInfoData;
-        devInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
+    void OnCalibrate(wxCommandEvent& event) {
+        std::vector<uint8_t> payload(1, factoryCheck->IsChecked() ? 1 : 0);
+        SubmitBatteryCommand(CMD_CALIBRATE, payload);
+    }
 
-        for (DWORD i = 0; SetupDiEnumDeviceInfo(hDevInfo, i, &devInfoData); i++) {
-            WCHAR friendlyName[256];
-            WCHAR portName[256];
-            DWORD propertyType;
-            DWORD requiredSize;
+    void OnTolerate(wxCommandEvent& event) {
+        SubmitBatteryCommand(CMD_TOLERATE, std::vector<uint8_t>());
+    }
 
-            // 获取友好名称
-            if (SetupDiGetDeviceRegistryProperty(hDevInfo, &devInfoData, SPDRP_FRIENDLYNAME,
-                &propertyType, (PBYTE)friendlyName, sizeof(friendlyName), &requiredSize)) {
-                
-                // 从注册表获取实际的COM端口名
-                HKEY hKey = SetupDiOpenDevRegKey(hDevInfo, &devInfoData,
-                    DICS_FLAG_GLOBAL, 0, DIREG_DEV, KEY_READ);
-                    
-                if (hKey != INVALID_HANDLE_VALUE) {
-                    DWORD portNameSize = sizeof(portName);
-                    DWORD type;
-                    if (RegQueryValueExW(hKey, L"PortName", NULL, &type,
-                        (LPBYTE)portName, &portNameSize) == ERROR_SUCCESS) {
-                        // 只添加COM端口
-                        if (wcsstr(portName, L"COM")) {
-                            portCombo->Append(portName);
-                        }
-                    }
-                    RegCloseKey(hKey);
-                }
+    void OnClean(wxCommandEvent& event) {
+        SubmitBatteryCommand(CMD_CLEAN, std::vector<uint8_t>());
+    }
+
+    void OnSetSn(wxCommandEvent& event) {
+        wxString sn = snEntry->GetValue().Trim().Trim(false);
+        if (sn.empty()) {
+            AppendLog("Error: Please input serial number\n");
+            return;
+        }
+        std::vector<uint8_t> payload;
+        BuildSerialNumber(sn.ToStdString(), payload);
+        SubmitBatteryCommand(CMD_SET_SN, payload);
+    }
+
+    void OnCommandDone(wxThreadEvent& event) {
+        CommandResult result = event.GetPayload<CommandResult>();
+        wxString msg = wxString::Format("%s: %s", CommandName(result.command),
+                                        CommandStatusName(result.status));
+        if (result.attempts > 1) {
+            msg += wxString::Format(" (%d attempts)", result.attempts);
+        }
+        AppendLog(msg + "\n");
+        statusBar->SetStatusText(msg);
+
+        // 写入成功后自动递增序列号，准备下一块电池
+        if (result.command == CMD_SET_SN && result.status == CMD_STATUS_OK && autoIncCheck->IsChecked()) {
+            snEntry->SetValue(IncrementSerialNumber(snEntry->GetValue().ToStdString()));
+        }
+    }
+
+    // 数据页：遥测曲线
+    wxPanel* CreateDataPanel(wxWindow* parent) {
+        wxPanel* dataPanel = new wxPanel(parent);
+        wxBoxSizer* dataSizer = new wxBoxSizer(wxVERTICAL);
+
+        wxBoxSizer* row = new wxBoxSizer(wxHORIZONTAL);
+        wxButton* clearBtn = new wxButton(dataPanel, wxID_ANY, "Clear");
+        clearBtn->Bind(wxEVT_BUTTON, [this](wxCommandEvent&) {
+            link.GetSeries().Clear();
+            plotPanel->Refresh();
+        });
+        row->Add(clearBtn, 0, wxRIGHT, FromDIP(5));
+        row->Add(new wxStaticText(dataPanel, wxID_ANY, "Wheel: zoom   Drag: pan   Double-click: follow latest"),
+                 0, wxALIGN_CENTER_VERTICAL);
+        dataSizer->Add(row, 0, wxALL, FromDIP(5));
+
+        plotPanel = new PlotPanel(dataPanel, &link.GetSeries());
+        dataSizer->Add(plotPanel, 1, wxEXPAND | wxALL, FromDIP(5));
+
+        dataPanel->SetSizer(dataSizer);
+        return dataPanel;
+    }
+
+    wxPanel* CreateFirmwarePanel(wxWindow* parent) {
+        wxPanel* firmwarePanel = new wxPanel(parent);
+        wxBoxSizer* firmwareSizer = new wxBoxSizer(wxVERTICAL);
+
+        // 第一行：镜像文件选择 + 下载按钮
+        wxBoxSizer* row1 = new wxBoxSizer(wxHORIZONTAL);
+        wxStaticText* label = new wxStaticText(firmwarePanel, wxID_ANY, "Image:");
+        otaPathEntry = new wxTextCtrl(firmwarePanel, wxID_ANY, "ota.bin");
+        otaSelectBtn = new wxButton(firmwarePanel, wxID_ANY, "Select File");
+        otaDownloadBtn = new wxButton(firmwarePanel, wxID_ANY, "Download");
+        row1->Add(label, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, FromDIP(5));
+        row1->Add(otaPathEntry, 1, wxEXPAND | wxRIGHT, FromDIP(5));
+        row1->Add(otaSelectBtn, 0, wxRIGHT, FromDIP(5));
+        row1->Add(otaDownloadBtn, 0);
+        firmwareSizer->Add(row1, 0, wxEXPAND | wxALL, FromDIP(10));
+
+        // 第二行：按块比较更新，只写入 CRC 不一致的块
+        wxBoxSizer* row2 = new wxBoxSizer(wxHORIZONTAL);
+        wxStaticText* addrLabel = new wxStaticText(firmwarePanel, wxID_ANY, "Flash Address:");
+        otaAddrEntry = new wxTextCtrl(firmwarePanel, wxID_ANY, "0x0000", wxDefaultPosition, FromDIP(wxSize(80, -1)));
+        otaUpdateBtn = new wxButton(firmwarePanel, wxID_ANY, "Verify/Update");
+        row2->Add(addrLabel, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, FromDIP(5));
+        row2->Add(otaAddrEntry, 0, wxRIGHT, FromDIP(5));
+        row2->Add(otaUpdateBtn, 0, wxRIGHT, FromDIP(10));
+        fastLinkCheck = new wxCheckBox(firmwarePanel, wxID_ANY, "Fast link");
+        fastLinkCheck->SetToolTip("Negotiate up to 3 Mbaud with the device for the transfer, then switch back");
+        row2->Add(fastLinkCheck, 0, wxALIGN_CENTER_VERTICAL);
+        firmwareSizer->Add(row2, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, FromDIP(10));
+
+        // 第三行：进度条
+        otaGauge = new wxGauge(firmwarePanel, wxID_ANY, 100);
+        firmwareSizer->Add(otaGauge, 0, wxEXPAND | wxLEFT | wxRIGHT, FromDIP(10));
+
+        // 第四行：进度和吞吐
+        otaRateLabel = new wxStaticText(firmwarePanel, wxID_ANY, "");
+        firmwareSizer->Add(otaRateLabel, 0, wxEXPAND | wxALL, FromDIP(10));
+
+        firmwarePanel->SetSizer(firmwareSizer);
+        return firmwarePanel;
+    }
+
+    void OnOtaSelect(wxCommandEvent& event) {
+        wxFileDialog openFileDialog(this, "Select OTA Image", "", "", "Binary files (*.bin)|*.bin", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+        if (openFileDialog.ShowModal() == wxID_OK) {
+            otaPathEntry->SetValue(openFileDialog.GetPath());
+        }
+    }
+
+    // 下载过程中再次点击为中止，返回 true 表示已处理
+    // 中止后要等任务的命令回调全部返回（IsFinished）才能开始新任务并删除旧任务
+    bool AbortFirmwareJob() {
+        // 协商中途停下会让两端速率不一致，等它结束
+        if (negotiating) return true;
+        // 正在切回原速率准备重试，取消重试
+        if (retryBelowBaud) {
+            retryBelowBaud = 0;
+            AppendLog("Retry cancelled\n");
+            return true;
+        }
+        if (firmwareJob && !firmwareJob->IsFinished()) {
+            firmwareAborted = true;
+            firmwareJob->Abort();
+            return true;
+        }
+        return false;
+    }
+
+    // 读取镜像文件，失败时返回空
+    std::vector<uint8_t> LoadFirmwareImage() {
+        std::vector<uint8_t> image;
+        if (!link.GetEngine()) {
+            AppendLog("Error: Serial port not open in binary framing mode\n");
+            return image;
+        }
+
+        std::ifstream file(otaPathEntry->GetValue().ToStdString(), std::ios::binary);
+        if (!file) {
+            AppendLog("Error: Could not open " + otaPathEntry->GetValue() + "\n");
+            return image;
+        }
+        image.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (image.empty()) {
+            AppendLog("Error: Image file is empty\n");
+        }
+        return image;
+    }
+
+    void OnOtaDownload(wxCommandEvent& event) {
+        if (AbortFirmwareJob()) return;
+
+        std::vector<uint8_t> image = LoadFirmwareImage();
+        if (image.empty()) return;
+
+        AppendLog(wxString::Format("\nStart download, %u bytes...\n", (unsigned)image.size()));
+        StartFirmwareJob([this, image]() -> FirmwareJob* { return new OtaTransfer(link.GetEngine(), image); },
+                         otaDownloadBtn);
+    }
+
+    // 打开多端口工位窗口，端口列表和参数取自当前设置
+    void OnStation(wxCommandEvent& event) {
+        wxArrayString ports;
+        for (unsigned int i = 0; i < portCombo->GetCount(); i++) {
+            ports.Add(portCombo->GetString(i));
+        }
+        long baud = 115200;
+        baudCombo->GetValue().ToLong(&baud);
+        // 工位只能用二进制协议，当前选的是文本模式时默认用 COBS
+        int mode = framingCombo->GetSelection() > 0 ? framingCombo->GetSelection() : FRAME_COBS;
+
+        StationFrame* frame = new StationFrame(this, ports, baud, mode, otaPathEntry->GetValue(),
+                                               otaAddrEntry->GetValue(), snEntry->GetValue(),
+                                               autoIncCheck->IsChecked());
+        frame->Show();
+    }
+
+    // 按块比较 CRC 后只写入不同的块，断线重连后再次执行即可续传
+    void OnOtaUpdate(wxCommandEvent& event) {
+        if (AbortFirmwareJob()) return;
+
+        unsigned long address = 0;
+        if (!otaAddrEntry->GetValue().ToULong(&address, 16)) {
+            AppendLog("Error: Invalid flash address\n");
+            return;
+        }
+        std::vector<uint8_t> image = LoadFirmwareImage();
+        if (image.empty()) return;
+
+        AppendLog(wxString::Format("\nStart verify/update at 0x%lX, %u bytes...\n",
+                                             address, (unsigned)image.size()));
+        uint32_t flashAddress = static_cast<uint32_t>(address);
+        StartFirmwareJob([this, image, flashAddress]() -> FirmwareJob* {
+            return new FlashDiffUpdate(link.GetEngine(), image, flashAddress);
+        }, otaUpdateBtn);
+    }
+
+    void StartFirmwareJob(const std::function<FirmwareJob*()>& factory, wxButton* button) {
+        makeFirmwareJob = factory;
+        firmwareAttempts = 0;
+        retryBelowBaud = 0;
+        firmwareAborted = false;
+        otaDownloadBtn->Enable(button == otaDownloadBtn);
+        otaUpdateBtn->Enable(button == otaUpdateBtn);
+        button->SetLabel("Abort");
+
+        delete linkSpeed;
+        linkSpeed = nullptr;
+        if (fastLinkCheck->IsChecked()) {
+            linkSpeed = new BaudNegotiator(link.GetEngine(), [this](int baud) { return link.SetBaudRate(baud); },
+                                           link.GetBaudRate());
+        }
+        RunFirmwareJob();
+    }
+
+    // 创建任务并开始一次传输，需要提速的先协商；旧任务已经 IsFinished，不会再有它的回调
+    void RunFirmwareJob() {
+        if (firmwareJob) delete firmwareJob;
+        firmwareJob = makeFirmwareJob();
+        firmwareAttempts++;
+        firmwareJob->SetBaudRate(link.GetBaudRate());
+        firmwareJob->SetProgressHandler([this](const OtaProgress& progress) {
+            wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_OTA_PROGRESS);
+            event->SetPayload(progress);
+            wxQueueEvent(this, event);
+        });
+        uint32_t generation = linkGeneration;
+        firmwareJob->SetDoneHandler([this, generation](bool ok, const std::string& message) {
+            wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_OTA_DONE);
+            event->SetInt(ok ? 1 : 0);
+            event->SetExtraLong(generation);
+            event->SetString(wxString::FromUTF8(message.c_str()));
+            wxQueueEvent(this, event);
+        });
+
+        otaGauge->SetValue(0);
+
+        if (!linkSpeed) {
+            firmwareJob->Start();
+            return;
+        }
+        // 先提速，结果在 OnLinkSpeed 里处理后再开始传输
+        negotiating = true;
+        AppendLog("Negotiating link speed...\n");
+        linkSpeed->Raise([this, generation](bool ok, int baud, const std::string& message) {
+            PostLinkSpeed(false, ok, baud, message, generation);
+        });
+    }
+
+    void PostLinkSpeed(bool restore, bool ok, int baud, const std::string& message, uint32_t generation) {
+        LinkSpeedChange change;
+        change.generation = generation;
+        change.restore = restore;
+        change.ok = ok;
+        change.baud = baud;
+        change.message = message;
+        wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_LINK_SPEED);
+        event->SetPayload(change);
+        wxQueueEvent(this, event);
+    }
+
+    void OnLinkSpeed(wxThreadEvent& event) {
+        LinkSpeedChange change = event.GetPayload<LinkSpeedChange>();
+        // 旧连接的结果：对象可能已经删除，状态由 OnDisconnectComplete 复位
+        if (change.generation != linkGeneration) return;
+        connectedBaud = change.baud;
+        AppendLog(wxString::FromUTF8(change.message.c_str()) + "\n");
+        statusBar->SetStatusText(wxString::FromUTF8(change.message.c_str()));
+        if (change.restore) {
+            if (retryBelowBaud && change.ok && firmwareJob && linkSpeed) {
+                linkSpeed->LimitBelow(retryBelowBaud);
+                retryBelowBaud = 0;
+                RunFirmwareJob();
+                return;
+            }
+            retryBelowBaud = 0;
+            EnableFirmwareButtons();
+            return;
+        }
+
+        negotiating = false;
+        if (!change.ok) {
+            firmwareJob->Abort();
+            return;
+        }
+        firmwareJob->SetBaudRate(change.baud);
+        firmwareJob->Start();
+    }
+
+    // 电池命令和固件下载按钮，断开过程中禁用
+    void EnableLinkButtons(bool enable) {
+        resetBtn->Enable(enable);
+        calibrateBtn->Enable(enable);
+        tolerateBtn->Enable(enable);
+        cleanBtn->Enable(enable);
+        setSnBtn->Enable(enable);
+        if (enable) {
+            EnableFirmwareButtons();
+        } else {
+            otaDownloadBtn->Enable(false);
+            otaUpdateBtn->Enable(false);
+        }
+    }
+
+    void EnableFirmwareButtons() {
+        otaDownloadBtn->SetLabel("Download");
+        otaUpdateBtn->SetLabel("Verify/Update");
+        otaDownloadBtn->Enable(!isDisconnecting);
+        otaUpdateBtn->Enable(!isDisconnecting);
+    }
+
+    void OnOtaProgress(wxThreadEvent& event) {
+        OtaProgress progress = event.GetPayload<OtaProgress>();
+        otaGauge->SetValue(progress.total ? static_cast<int>(progress.bytesDone * 100 / progress.total) : 0);
+        // 有效吞吐与线路极限（每字节 10 bit）比较
+        double lineRate = connectedBaud / 10.0;
+        otaRateLabel->SetLabel(wxString::Format("%u / %u bytes, %.1f KB/s (%.0f%% of line rate), %u retransmits",
+                                                (unsigned)progress.bytesDone, (unsigned)progress.total,
+                                                progress.bytesPerSecond / 1024.0,
+                                                lineRate > 0 ? progress.bytesPerSecond * 100.0 / lineRate : 0.0,
+                                                progress.retransmits));
+    }
+
+    void OnOtaDone(wxThreadEvent& event) {
+        if (static_cast<uint32_t>(event.GetExtraLong()) != linkGeneration) return;
+        // 结果用任务自己的消息（下载、校验/更新各不相同）
+        AppendLog(event.GetString() + "\n");
+        statusBar->SetStatusText(event.GetString());
+
+        // 提过速的先切回原速率，完成后才能开始下一次传输；失败的切回后降一档重试
+        if (linkSpeed && linkSpeed->GetBaudRate() != linkSpeed->GetBaseBaudRate()) {
+            if (!event.GetInt() && !firmwareAborted && firmwareAttempts < MAX_FIRMWARE_ATTEMPTS) {
+                retryBelowBaud = linkSpeed->GetBaudRate();
+                AppendLog(wxString::Format("Retrying below %d baud (attempt %d of %d)...\n",
+                                           retryBelowBaud, firmwareAttempts + 1, MAX_FIRMWARE_ATTEMPTS));
             }
+            uint32_t generation = linkGeneration;
+            linkSpeed->Restore([this, generation](bool ok, int baud, const std::string& message) {
+                PostLinkSpeed(true, ok, baud, message, generation);
+            });
+            return;
         }
+        EnableFirmwareButtons();
+    }
 
-        SetupDiDestroyDeviceInfoList(hDevInfo);
+    // 定时刷新电池面板，暂停时快照照常更新，只是不显示
+    void OnTelemetryTimer(wxTimerEvent& event) {
+        // 曲线页可见且跟随最新数据时才重画
+        if (plotPanel->IsFollowing() && plotPanel->IsShownOnScreen()) {
+            plotPanel->Refresh();
+        }
+        if (hexView->IsShown() && hexView->NeedsRefresh()) {
+            hexView->Refresh();
+        }
+
+        if (pauseCheck->IsChecked()) return;
+
+        TelemetryRecord rec;
+        if (!link.GetTelemetry().Fetch(telemetryVersion, rec)) return;
 
-        // 如果有可用端口，选择第一个
-        if (portCombo->GetCount() > 0) {
+        wxString values[8];
+        values[0] = wxString::Format("%02u:%02u:%02u", rec.batteryTime / 3600,
+                                     (rec.batteryTime / 60) % 60, rec.batteryTime % 60);
+        values[1] = wxString::Format("%.3f", rec.voltage / 1000.0);
+        values[2] = wxString::Format("%.3f", rec.cellVoltage / 1000.0);
+        values[3] = wxString::Format("%.3f", rec.current / 1000.0);
+        values[4] = wxString::Format("%.1f", rec.temperature / 10.0);
+        values[5] = wxString::Format("%u", rec.capacity);
+        values[6] = wxString::Format("%u", rec.cycles);
+        values[7] = wxString::FromUTF8(rec.sn);
+
+        for (int i = 0; i < 8; i++) {
+            if (values[i] != shownValues[i]) {
+                batteryEntries[i]->ChangeValue(values[i]);
+                shownValues[i] = values[i];
+            }
+        }
+    }
+
+    // 枚举在后台线程中进行，结果通过 OnPortsChanged 更新下拉框
+    void OnRefreshPorts(wxCommandEvent& event) {
+        portDiscovery.Rescan();
+    }
+
+    // 只增删变化的端口，不打断用户当前的选择或输入
+    void OnPortsChanged(wxThreadEvent& event) {
+        PortChange change = event.GetPayload<PortChange>();
+        for (size_t i = 0; i < change.removed.size(); i++) {
+            wxString name = wxString::FromUTF8(change.removed[i].c_str());
+            int index = portCombo->FindString(name, true);
+            if (index != wxNOT_FOUND) portCombo->Delete(index);
+            if (!change.initial) AppendLog("Port removed: " + name + "\n");
+        }
+        for (size_t i = 0; i < change.added.size(); i++) {
+            wxString name = wxString::FromUTF8(change.added[i].c_str());
+            if (portCombo->FindString(name, true) == wxNOT_FOUND) {
+                portCombo->Append(name);
+            }
+            if (!change.initial) AppendLog("Port added: " + name + "\n");
+        }
+
+        // 如果还没有选择端口，选择第一个
+        if (portCombo->GetValue().IsEmpty() && portCombo->GetCount() > 0) {
             portCombo->SetSelection(0);
         }
     }
+
+#ifdef __WXMSW__
+    // 设备插拔时系统向顶层窗口广播 WM_DEVICECHANGE
+    WXLRESULT MSWWindowProc(WXUINT message, WXWPARAM wParam, WXLPARAM lParam) override {
+        if (message == WM_DEVICECHANGE) {
+            portDiscovery.Rescan();
+        }
+        return wxFrame::MSWWindowProc(message, wParam, lParam);
+    }
+#endif
+
+    // 状态栏第二栏显示吞吐和各阶段延迟（上次刷新以来的 p99），设置了导出文件时同时写文件
+    void OnMetricsTimer(wxTimerEvent& event) {
+        MetricsSnapshot now = metrics.Snapshot();
+        statusBar->SetStatusText(wxString::Format(
+            "RX %.1f KB/s  TX %.1f KB/s  read>evt p99 %.0fus  evt>UI p99 %.0fus  write p99 %.0fus  queue %lld  dropped %llu",
+            MetricsRate(now.rxBytes, lastMetrics.rxBytes, now.time, lastMetrics.time) / 1024,
+            MetricsRate(now.txBytes, lastMetrics.txBytes, now.time, lastMetrics.time) / 1024,
+            now.readToEvent.Since(lastMetrics.readToEvent).Percentile(0.99),
+            now.eventToUi.Since(lastMetrics.eventToUi).Percentile(0.99),
+            now.enqueueToWrite.Since(lastMetrics.enqueueToWrite).Percentile(0.99),
+            (long long)now.sendQueueDepth, (unsigned long long)now.droppedBytes), 1);
+
+        if (!metricsPath.empty()) {
+            // 扩展名 .prom 导出 Prometheus 文本格式，其他导出 JSON；累计值和本次间隔的值都导出
+            bool prometheus = metricsPath.size() > 5 && metricsPath.compare(metricsPath.size() - 5, 5, ".prom") == 0;
+            WriteMetricsFile(metricsPath, prometheus ? FormatMetricsPrometheus(now, lastMetrics)
+                                                     : FormatMetricsJson(now, lastMetrics));
+        }
+        lastMetrics = now;
+    }
+
+public:
+    // 定期把指标写到文件（命令行 --metrics <path>）
+    void SetMetricsExport(const std::string& path) { metricsPath = path; }
+
+private:
     void OnSendError(wxThreadEvent& event) {
         wxString errorMsg = event.GetString();
-        logText->AppendText("Error: " + errorMsg + "\n");
+        AppendLog("Error: " + errorMsg + "\n");
         statusBar->SetStatusText(errorMsg);
     }
 public:
@@ -467,18 +1638,39 @@ public:
         ID_SERIAL_DATA,
         ID_DISCONNECT_COMPLETE,
         ID_SEND_COMPLETE,
-        ID_SEND_ERROR
+        ID_SEND_ERROR,
+        ID_SERIAL_FRAME,
+        ID_TELEMETRY_TIMER,
+        ID_COMMAND_DONE,
+        ID_OTA_PROGRESS,
+        ID_OTA_DONE,
+        ID_PORTS_CHANGED,
+        ID_METRICS_TIMER,
+        ID_LINK_SPEED,
+        ID_FILTER_TIMER,
+        ID_LOG_SEARCH
     };
     SerialFrame() : wxFrame(nullptr, wxID_ANY, "Serial Tool", 
                            wxDefaultPosition, wxDefaultSize) 
     {
         // 初始化串口相关变量
-        hSerial = INVALID_HANDLE_VALUE;
-        serialThread = nullptr;
+        firmwareJob = nullptr;
+        connectedBaud = 115200;
+        linkSpeed = nullptr;
+        linkGeneration = 0;
+        negotiating = false;
+        firmwareAttempts = 0;
+        retryBelowBaud = 0;
+        firmwareAborted = false;
+        filterMatches = 0;
+        searchGeneration = 0;
+        searchActive = true;
+        hexMode = false;
         isRunning = false;
         isDisconnecting = false;
         isSending = false;
         sendThread = nullptr;
+        telemetryVersion = 0;
 
         // 使用 DIP 设置窗口大小
         SetSize(FromDIP(wxSize(800, 600)));
@@ -510,9 +1702,28 @@ public:
         baudRates.Add("38400");
         baudRates.Add("57600");
         baudRates.Add("115200");
+        baudRates.Add("230400");
+        baudRates.Add("460800");
+        baudRates.Add("921600");
+        baudRates.Add("1000000");
+        baudRates.Add("1500000");
+        baudRates.Add("2000000");
+        baudRates.Add("3000000");
         baudCombo->Append(baudRates);
         baudCombo->SetValue("115200");
         hbox1->Add(baudCombo, 0, wxALL, margin);
+
+        // 分帧方式，顺序与 FrameMode 一致
+        wxArrayString framings;
+        framings.Add("Text");
+        framings.Add("COBS");
+        framings.Add("SLIP");
+        framings.Add("Length");
+        framingCombo = new wxComboBox(mainPanel, wxID_ANY, "Text",
+                                    wxDefaultPosition,
+                                    FromDIP(wxSize(80, -1)),
+                                    framings, wxCB_READONLY);
+        hbox1->Add(framingCombo, 0, wxALL, margin);
         
         refreshBtn = new wxButton(mainPanel, wxID_ANY, "Refresh");
         refreshBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnRefreshPorts, this);
@@ -520,6 +1731,10 @@ public:
         
         connectBtn = new wxButton(mainPanel, wxID_ANY, "Connect");
         hbox1->Add(connectBtn, 0, wxALL, margin);
+
+        stationBtn = new wxButton(mainPanel, wxID_ANY, "Station...");
+        stationBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnStation, this);
+        hbox1->Add(stationBtn, 0, wxALL, margin);
         
         vbox->Add(hbox1, 0, wxEXPAND);
 
@@ -527,19 +1742,47 @@ public:
         notebook = new wxNotebook(mainPanel, wxID_ANY);
         notebook->AddPage(CreateBatteryPanel(notebook), "Battery");
         wxPanel* infoPanel = new wxPanel(notebook);
-        wxPanel* dataPanel = new wxPanel(notebook);
         notebook->AddPage(infoPanel, "Information");
-        notebook->AddPage(dataPanel, "Data");
+        notebook->AddPage(CreateDataPanel(notebook), "Data");
+        notebook->AddPage(CreateFirmwarePanel(notebook), "Firmware");
         
         vbox->Add(notebook, 1, wxEXPAND | wxALL, margin);
 
-        // 第三行：日志文本框
+        // 第三行：日志过滤和日志文本框
+        wxBoxSizer* filterBox = new wxBoxSizer(wxHORIZONTAL);
+        filterBox->Add(new wxStaticText(mainPanel, wxID_ANY, "Filter:"), 0, wxALIGN_CENTER_VERTICAL | wxLEFT, margin);
+        filterText = new wxTextCtrl(mainPanel, wxID_ANY);
+        filterText->SetHint("Substring or regex; empty shows the full log");
+        filterText->Bind(wxEVT_TEXT, &SerialFrame::OnFilterChanged, this);
+        filterBox->Add(filterText, 1, wxALL | wxEXPAND, margin);
+        regexCheck = new wxCheckBox(mainPanel, wxID_ANY, "Regex");
+        regexCheck->Bind(wxEVT_CHECKBOX, &SerialFrame::OnFilterChanged, this);
+        filterBox->Add(regexCheck, 0, wxALIGN_CENTER_VERTICAL | wxALL, margin);
+        caseCheck = new wxCheckBox(mainPanel, wxID_ANY, "Match case");
+        caseCheck->Bind(wxEVT_CHECKBOX, &SerialFrame::OnFilterChanged, this);
+        filterBox->Add(caseCheck, 0, wxALIGN_CENTER_VERTICAL | wxALL, margin);
+        filterLabel = new wxStaticText(mainPanel, wxID_ANY, "");
+        filterBox->Add(filterLabel, 0, wxALIGN_CENTER_VERTICAL | wxALL, margin);
+        wxArrayString views;
+        views.Add("Text");
+        views.Add("Hex");
+        viewCombo = new wxComboBox(mainPanel, wxID_ANY, "Text",
+                                   wxDefaultPosition,
+                                   FromDIP(wxSize(70, -1)),
+                                   views, wxCB_READONLY);
+        viewCombo->Bind(wxEVT_COMBOBOX, &SerialFrame::OnViewChanged, this);
+        filterBox->Add(viewCombo, 0, wxALIGN_CENTER_VERTICAL | wxALL, margin);
+        vbox->Add(filterBox, 0, wxEXPAND);
+
         logText = new wxTextCtrl(mainPanel, wxID_ANY, "", 
                                 wxDefaultPosition, wxDefaultSize,
                                 wxTE_MULTILINE | wxTE_READONLY | wxHSCROLL);
         // 设置更好的字体渲染
         logText->SetFont(logText->GetFont().Scale(GetContentScaleFactor()));
         vbox->Add(logText, 2, wxEXPAND | wxALL, margin);
+        hexView = new HexView(mainPanel, &hexStore);
+        hexView->Hide();
+        vbox->Add(hexView, 2, wxEXPAND | wxALL, margin);
 
         // 第四行：发送区域
         wxBoxSizer* hbox4 = new wxBoxSizer(wxHORIZONTAL);
@@ -550,47 +1793,133 @@ public:
         
         sendBtn = new wxButton(mainPanel, wxID_ANY, "Send");
         hbox4->Add(sendBtn, 0, wxALL, margin);
+
+        // 抓包和回放
+        captureBtn = new wxButton(mainPanel, wxID_ANY, "Record...");
+        captureBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnCapture, this);
+        hbox4->Add(captureBtn, 0, wxALL, margin);
+
+        wxArrayString speeds;
+        speeds.Add("1x");
+        speeds.Add("10x");
+        speeds.Add("Max");
+        replaySpeedCombo = new wxComboBox(mainPanel, wxID_ANY, "1x",
+                                        wxDefaultPosition,
+                                        FromDIP(wxSize(60, -1)),
+                                        speeds, wxCB_READONLY);
+        hbox4->Add(replaySpeedCombo, 0, wxALL, margin);
+
+        replayBtn = new wxButton(mainPanel, wxID_ANY, "Replay...");
+        replayBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnReplay, this);
+        hbox4->Add(replayBtn, 0, wxALL, margin);
         
         vbox->Add(hbox4, 0, wxEXPAND);
 
         mainPanel->SetSizer(vbox);
 
         // 创建状态栏
-        statusBar = CreateStatusBar();
+        statusBar = CreateStatusBar(2);
+        int statusWidths[2] = { -1, -3 };
+        statusBar->SetStatusWidths(2, statusWidths);
         statusBar->SetStatusText("Disconnected");
         statusBar->SetFont(statusBar->GetFont().Scale(GetContentScaleFactor()));
         
         Centre();
 
 
+        // 串口连接的回调都在接收线程中执行，转成事件交给界面线程
+        link.SetRawHandler([this](const uint8_t* data, size_t length) { OnLinkRaw(data, length); });
+        link.SetFrameHandler([this](const BatteryFrame& frame) { OnLinkFrame(frame); });
+        link.SetErrorHandler([this](const std::string& message) { OnLinkError(message); });
+        link.SetTapHandler([this](int direction, const uint8_t* data, size_t length) {
+            hexStore.Append(direction, data, length);
+        });
+
         // 绑定事件
         connectBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnConnect, this);
         sendBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnSend, this);
         Bind(wxEVT_THREAD, &SerialFrame::OnSerialData, this, ID_SERIAL_DATA);
+        Bind(wxEVT_THREAD, &SerialFrame::OnSerialFrame, this, ID_SERIAL_FRAME);
         // 绑定断开连接完成事件
         Bind(wxEVT_THREAD, &SerialFrame::OnDisconnectComplete, this, ID_DISCONNECT_COMPLETE);
         Bind(wxEVT_THREAD, &SerialFrame::OnSendComplete, this, ID_SEND_COMPLETE);
         Bind(wxEVT_THREAD, &SerialFrame::OnSendError, this, ID_SEND_ERROR);
+        Bind(wxEVT_THREAD, &SerialFrame::OnCommandDone, this, ID_COMMAND_DONE);
+
+        // 电池面板按钮
+        resetBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnReset, this);
+        calibrateBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnCalibrate, this);
+        tolerateBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnTolerate, this);
+        cleanBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnClean, this);
+        setSnBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnSetSn, this);
+
+        // 固件下载
+        otaSelectBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnOtaSelect, this);
+        otaDownloadBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnOtaDownload, this);
+        otaUpdateBtn->Bind(wxEVT_BUTTON, &SerialFrame::OnOtaUpdate, this);
+        Bind(wxEVT_THREAD, &SerialFrame::OnOtaProgress, this, ID_OTA_PROGRESS);
+        Bind(wxEVT_THREAD, &SerialFrame::OnOtaDone, this, ID_OTA_DONE);
+        Bind(wxEVT_THREAD, &SerialFrame::OnLinkSpeed, this, ID_LINK_SPEED);
+        Bind(wxEVT_THREAD, &SerialFrame::OnPortsChanged, this, ID_PORTS_CHANGED);
+
+        // 电池面板刷新定时器
+        telemetryTimer = new wxTimer(this, ID_TELEMETRY_TIMER);
+        Bind(wxEVT_TIMER, &SerialFrame::OnTelemetryTimer, this, ID_TELEMETRY_TIMER);
+        telemetryTimer->Start(TELEMETRY_REFRESH_MS);
+
+        // 链路指标
+        link.SetMetrics(&metrics);
+        lastMetrics = metrics.Snapshot();
+        metricsTimer = new wxTimer(this, ID_METRICS_TIMER);
+        Bind(wxEVT_TIMER, &SerialFrame::OnMetricsTimer, this, ID_METRICS_TIMER);
+        metricsTimer->Start(METRICS_REFRESH_MS);
+
+        // 日志过滤
+        filterTimer = new wxTimer(this, ID_FILTER_TIMER);
+        Bind(wxEVT_TIMER, &SerialFrame::OnFilterTimer, this, ID_FILTER_TIMER);
+        Bind(wxEVT_THREAD, &SerialFrame::OnLogSearch, this, ID_LOG_SEARCH);
+        searchThread = new std::thread(&SerialFrame::SearchThreadFunction, this);
 
         // 在析构时确保线程正确关闭
         // 修改窗口关闭事件处理
         Bind(wxEVT_CLOSE_WINDOW, [this](wxCloseEvent& event) {
-            if (hSerial != INVALID_HANDLE_VALUE) {
+            if (link.IsOpen()) {
                 isRunning = false;
-                if (serialThread) {
-                    serialThread->join();  // 在关闭窗口时我们必须等待
-                    delete serialThread;
-                }
-                CloseSerial();
+                CloseLink();  // 在关闭窗口时我们必须等待接收线程退出
             }
             event.Skip();
         });
 
-        wxCommandEvent dummy;
-        OnRefreshPorts(dummy);
+        // 端口在后台枚举，窗口不等枚举完成就显示
+        portDiscovery.SetChangeHandler([this](const std::vector<std::string>& added,
+                                              const std::vector<std::string>& removed, bool initial) {
+            PortChange change;
+            change.added = added;
+            change.removed = removed;
+            change.initial = initial;
+            wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, ID_PORTS_CHANGED);
+            event->SetPayload(change);
+            wxQueueEvent(this, event);
+        });
+        portDiscovery.Start();
     }
 
     ~SerialFrame() {
+        portDiscovery.Stop();
+        telemetryTimer->Stop();
+        delete telemetryTimer;
+        metricsTimer->Stop();
+        delete metricsTimer;
+        filterTimer->Stop();
+        delete filterTimer;
+        {
+            std::lock_guard<std::mutex> lock(searchMutex);
+            searchActive = false;
+        }
+        searchCondition.notify_one();
+        searchThread->join();
+        delete searchThread;
+
         isRunning = false;
         sendCondition.notify_one();
         if (sendThread) {
@@ -598,14 +1927,7 @@ public:
             delete sendThread;
         }
         // 确保清理
-        if (hSerial != INVALID_HANDLE_VALUE) {
-            isRunning = false;
-            if (serialThread) {
-                serialThread->join();
-                delete serialThread;
-            }
-            CloseSerial();
-        }
+        CloseLink();
     }
 };
 
@@ -618,6 +1940,12 @@ public:
         #endif
         
         SerialFrame* frame = new SerialFrame();
+        // --metrics <path>：定期导出链路指标（.prom 为 Prometheus 文本格式，其他为 JSON）
+        for (int i = 1; i + 1 < argc; i++) {
+            if (argv[i] == wxString("--metrics")) {
+                frame->SetMetricsExport(argv[i + 1].ToStdString());
+            }
+        }
         frame->Show(true);
         return true;
     }